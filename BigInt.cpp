@@ -1,23 +1,26 @@
 /****************************************************************
  * BigInt.cpp -- big integer package for C++
  ****************************************************************/
+#include <atomic>
 #include <iostream>
+#include <string>
+#include <utility>
 #include "BigInt.h"
+#include "BigIntLimbs.h"
 
 using namespace std;
 
 /*****************************************************************
  * member functions for BigInt class
  *
- * Presently dummied up:
- * - does not implement integer values larger than the 'long' data
- *   type
- * - only operations related to '+' and '==' operator are defined
- * 
+ * The digit loops live in BigIntLimbs.cpp; the member functions
+ * here deal with signs, infinity and undefined values and manage
+ * the data arrays.
+ *
  *****************************************************************/
 
 #if DEBUG
-static unsigned long long nextId = 0; // counter to assign unique ids
+static std::atomic<unsigned long long> nextId(0); // counter to assign unique ids
 
 // called whenever a new array is allocated
 inline void printDebugNew(long long id) {
@@ -34,12 +37,103 @@ inline void printDebugDelete(long long id) {
 }
 #endif;
 
+// point data at storage for n limbs: the inline buffer when it is
+// big enough, otherwise a new heap array
+void BigInt::allocateData(int n) {
+	if (n <= INLINE_LIMBS) {
+		data = inlineData;
+		dataCapacity = INLINE_LIMBS;
+#if DEBUG
+		// not allocating memory, so use a junk id
+		id = -1;
+#endif
+	}
+	else {
+		data = limbs::allocate(n);
+		dataCapacity = n;
+#if DEBUG
+		id = nextId++;
+		printDebugNew(id);
+#endif
+	}
+}
+
+// wrap an array from limbs::allocate() without copying it (small
+// values still move inline)
+BigInt BigInt::adopt(limb *p, int n) {
+	BigInt result(0, false);
+	result.data = p;
+	result.dataLength = n;
+	result.dataCapacity = n;
+#if DEBUG
+	result.id = nextId++;
+	printDebugNew(result.id);
+#endif
+	result.trim();
+	return result;
+}
+
+// return a heap array (if any) and leave data null
+void BigInt::releaseData() {
+	if (data != NULL && data != inlineData) {
+		limbs::release(data);
+#if DEBUG
+		printDebugDelete(id);
+#endif
+	}
+	data = NULL;
+	dataCapacity = 0;
+}
+
+// strip leading zeros from a freshly computed result, keep zero
+// positive, and bring small results back into the inline buffer
+void BigInt::trim() {
+	trimLength();
+	if (dataLength <= INLINE_LIMBS && data != inlineData) {
+		limbs::copy(inlineData, data, dataLength);
+		releaseData();
+		data = inlineData;
+		dataCapacity = INLINE_LIMBS;
+	}
+}
+
+// strip leading zeros and keep zero positive, leaving the array
+// (and its spare room) alone
+void BigInt::trimLength() {
+	dataLength = limbs::normalize(data, dataLength);
+	if (dataLength == 1 && data[0] == 0) neg = false;
+}
+
+// move to a bigger heap array if this one holds fewer than n limbs;
+// the new one has half as much again as the old, so that steady
+// growth reallocates only a logarithmic number of times
+void BigInt::growData(int n) {
+	if (n <= dataCapacity) return;
+	int newCapacity = dataCapacity + dataCapacity / 2;
+	if (newCapacity < n) newCapacity = n;
+	moveData(newCapacity);
+}
+
+// move the limbs into a new heap array of exactly n limbs
+void BigInt::moveData(int n) {
+	limb *moved = limbs::allocate(n);
+	if (dataLength > 0) limbs::copy(moved, data, dataLength);
+	releaseData();
+	data = moved;
+	dataCapacity = n;
+#if DEBUG
+	id = nextId++;
+	printDebugNew(id);
+#endif
+}
+
 // copy constructor
 BigInt::BigInt(BigInt const& orig) {
 	this->dataLength = orig.dataLength;
 	// if infinity or undefined, set data to null
 	if (this->dataLength <= 0) {
 		this->data = NULL;
+		this->dataCapacity = 0;
 #if DEBUG
 		// not allocating memory, so use a junk id
 		this->id = -1;
@@ -47,120 +141,176 @@ BigInt::BigInt(BigInt const& orig) {
 	}
 	else {
 		// orig is a number, so copy the array
-		this->data = new short[this->dataLength];
+		allocateData(this->dataLength);
+		limbs::copy(this->data, orig.data, this->dataLength);
+	}
+	this->neg = orig.neg;
+}
+
+// move constructor
+BigInt::BigInt(BigInt&& orig) noexcept {
+	dataLength = orig.dataLength;
+	neg = orig.neg;
+	dataCapacity = orig.dataCapacity;
+	if (orig.data == orig.inlineData) {
+		// inline values are simply copied
+		data = inlineData;
+		limbs::copy(inlineData, orig.inlineData, dataLength);
 #if DEBUG
-		this->id = nextId;
-		nextId++;
-		printDebugNew(id);
+		id = -1;
 #endif
-		for (int i = 0; i < orig.dataLength; i++) {
-			this->data[i] = orig.data[i];
-		}
 	}
-	this->neg = orig.neg;
+	else {
+		// take over the heap array
+		data = orig.data;
+#if DEBUG
+		id = orig.id;
+		orig.id = -1;
+#endif
+	}
+	// leave orig undefined (which owns nothing)
+	orig.data = NULL;
+	orig.dataCapacity = 0;
+	orig.dataLength = -1;
+	orig.neg = false;
 }
 
 // constructor where operand is a long
 BigInt::BigInt(long num) {
-	// if num is zero, set values manually
-	if (num == 0) {
-		neg = false;
-		dataLength = 1;
-		data = new short[1];
+	// set negative bool
+	neg = (num < 0);
+	// a long always fits in a single (inline) limb; negate in
+	// unsigned arithmetic so that LONG_MIN does not overflow
+	dataLength = 1;
+	allocateData(1);
+	data[0] = neg ? (limb)0 - (limb)num : (limb)num;
+}
+
+// true for a digit of the given base (10 or 16)
+static inline bool isDigit(char c, bool hex) {
+	if (c >= '0' && c <= '9') return true;
+	return hex && ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+}
+
+// constructor from a decimal or hexadecimal string
+BigInt::BigInt(std::string_view text) {
+	// start out undefined, in case the text is not a number
+	data = NULL;
+	dataCapacity = 0;
+	dataLength = -1;
+	neg = false;
+
+	// optional sign, then optional hex prefix
+	size_t pos = 0;
+	bool negIn = false;
+	if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+		negIn = (text[pos] == '-');
+		pos++;
+	}
+	bool hex = (text.size() >= pos + 2 && text[pos] == '0' && (text[pos + 1] == 'x' || text[pos + 1] == 'X'));
+	if (hex) pos += 2;
+
+	// the rest must be a non-empty run of digits
+	bool valid = (pos < text.size());
+	for (size_t i = pos; i < text.size(); i++) {
+		if (!isDigit(text[i], hex)) valid = false;
+	}
+
+	if (valid) {
+		// convert straight into the limb array
+		const char *digits = text.data() + pos;
+		int len = (int)(text.size() - pos);
+		data = hex ? limbs::fromHex(digits, len, dataLength) : limbs::fromDecimal(digits, len, dataLength);
+		dataCapacity = dataLength;
+		neg = negIn;
 #if DEBUG
-		this->id = nextId;
-		nextId++;
+		id = nextId++;
 		printDebugNew(id);
 #endif
-		data[0] = 0;
+		trim();
 	}
-	else {
-		// num is nonzero, so...
-		// set negative bool
-		neg = (num < 0);
-		// force num to positive for later
-		if (neg) num *= -1;
-		dataLength = 0;
-		// just allocate the max possible number of
-		// digits for a 64-bit long
-		data = new short[19];
 #if DEBUG
-		this->id = nextId;
-		nextId++;
-		printDebugNew(id);
-#endif
-		while (num > 0) {
-			// pull digits out of num one at a time
-			data[dataLength] = num % 10;
-			num /= 10;
-			dataLength++;
-		}
+	else {
+		// not allocating memory, so use a junk id
+		id = -1;
 	}
+#endif
 }
 
-// constructor for building a BigInt from existing array
-BigInt::BigInt(int dataLengthIn, short *dataIn, bool negIn) {
-	// copy values, setting the data pointer to the existing array
+// constructor for a result of the given length, to be filled in by
+// the caller and then trimmed (or for a special value if length <= 0)
+BigInt::BigInt(int dataLengthIn, bool negIn) {
 	dataLength = dataLengthIn;
-	data = dataIn;
 	neg = negIn;
-#if DEBUG
 	if (dataLength > 0) {
-		id = nextId;
-		nextId++;
-		printDebugNew(id);
+		allocateData(dataLength);
 	}
 	else {
+		data = NULL;
+		dataCapacity = 0;
+#if DEBUG
 		// not allocating memory, so use a junk id
 		id = -1;
-	}
 #endif
-	// ensure that zeros are positive
-	if (dataLength == 1 && data[0] == 0) neg = false;
+	}
 }
-  
+
 // destructor
 BigInt::~BigInt() {
-	// if data is pointing to an array, free it
-	if (data != NULL) {
-		delete[] data;
-#if DEBUG
-		printDebugDelete(id);
-#endif
-	}
+	// if data is pointing to a heap array, free it
+	releaseData();
 }
 
 // assignment operator
-BigInt BigInt::operator=(BigInt const& src) {
-	// if this was not undefined or infinity
-	if (this->dataLength > 0) {
-		// return old array to heap
-		delete[] this->data;
-#if DEBUG
-		printDebugDelete(id);
-#endif
+BigInt& BigInt::operator=(BigInt const& src) {
+	// self-assignment would free the array we are about to copy
+	if (this == &src) return *this;
+
+	// reuse our array when the value fits, otherwise swap it for one
+	// of the right size
+	if (src.dataLength > dataCapacity) {
+		releaseData();
+		allocateData(src.dataLength);
 	}
 
 	this->dataLength = src.dataLength;
 
-	// if source is not undefined or infinity
+	// if source is not undefined or infinity, copy limbs
 	if (this->dataLength > 0) {
-		// allocate space and copy digits
-		this->data = new short[this->dataLength];
-#if DEBUG
-		this->id = nextId;
-		nextId++;
-		printDebugNew(id);
-#endif
-		for (int i = 0; i < this->dataLength; i++) {
-			this->data[i] = src.data[i];
-		}
+		limbs::copy(this->data, src.data, this->dataLength);
+	}
+	this->neg = src.neg;
+	return *this;
+}
+
+// move assignment operator
+BigInt& BigInt::operator=(BigInt&& src) noexcept {
+	if (this == &src) return *this;
+
+	// return old array to heap
+	releaseData();
+
+	dataLength = src.dataLength;
+	neg = src.neg;
+	dataCapacity = src.dataCapacity;
+	if (src.data == src.inlineData) {
+		// inline values are simply copied
+		data = inlineData;
+		limbs::copy(inlineData, src.inlineData, dataLength);
 	}
 	else {
-		// source is undefined or infinity, so ignore data
-		this->data = NULL;
+		// take over the heap array
+		data = src.data;
+#if DEBUG
+		id = src.id;
+		src.id = -1;
+#endif
 	}
-	this->neg = src.neg;
+	// leave src undefined (which owns nothing)
+	src.data = NULL;
+	src.dataCapacity = 0;
+	src.dataLength = -1;
+	src.neg = false;
 	return *this;
 }
 
@@ -170,40 +320,19 @@ BigInt BigInt::sum(BigInt const& other) const {
 	if (dataLength == -1) return *this;
 	if (other.dataLength == -1) return other;
 	// if either operand is infinity, return infinity
-	if (dataLength == 0 || other.dataLength == 0) return BigInt(0, NULL, neg);
+	if (dataLength == 0 || other.dataLength == 0) return BigInt(0, neg);
 
-	// find max possible length of sum
-	int tempLength = (this->dataLength > other.dataLength) ? this->dataLength + 1 : other.dataLength + 1;
-
-	short *resultArr = new short[tempLength];
-	short carry = 0;
-	short sum, thisDigit, otherDigit;
-
-	// sum digits from right to left, carrying appropriately
-	for (int i = 0; i < tempLength; i++) {
-		// if we run out of digits in either number, use a 0
-		thisDigit = (i < this->dataLength) ? this->data[i] : 0;
-		otherDigit = (i < other.dataLength) ? other.data[i] : 0;
-		// sum the digits, including a possible carry
-		sum = thisDigit + otherDigit + carry;
-		if (sum > 9) {
-			carry = 1;
-			sum -= 10;
-		}
-		else {
-			carry = 0;
-		}
-		resultArr[i] = sum;
-	}
+	// put the longer operand first for the limb kernel
+	BigInt const& top = (this->dataLength >= other.dataLength) ? *this : other;
+	BigInt const& bottom = (this->dataLength >= other.dataLength) ? other : *this;
 
-	// count the leading zeros in the sum
-	int leadingZeros = 0;
-	while (resultArr[(tempLength - leadingZeros) - 1] == 0) {
-		leadingZeros++;
-	}
-	if (leadingZeros == tempLength) leadingZeros--;
+	// find max possible length of sum
+	int tempLength = top.dataLength + 1;
 
-	return BigInt(tempLength - leadingZeros, resultArr, this->neg);
+	BigInt result(tempLength, this->neg);
+	result.data[tempLength - 1] = limbs::add(result.data, top.data, top.dataLength, bottom.data, bottom.dataLength);
+	result.trim();
+	return result;
 }
 
 // binary difference
@@ -212,66 +341,35 @@ BigInt BigInt::difference(BigInt const& other) const {
 	if (dataLength == -1) return *this;
 	if (other.dataLength == -1) return other;
 	// infinity-infinity is undefined
-	if (dataLength == 0 && other.dataLength == 0) return BigInt(-1, NULL, false);
+	if (dataLength == 0 && other.dataLength == 0) return BigInt(-1, false);
 	// if infinity-number or number-infinity, then return infinity
 	if (dataLength == 0) return *this;
-	if (other.dataLength == 0) return BigInt(0, NULL, !neg);
-
-	// find max possible length of difference
-	int tempLength = (this->dataLength > other.dataLength) ? this->dataLength : other.dataLength;
+	if (other.dataLength == 0) return BigInt(0, !neg);
 
-	BigInt top = NULL, bottom = NULL;
+	bool resultNeg;
+	const BigInt *top, *bottom;
 
-	bool resultNeg = NULL;
-	
 	// put the larger absolute value on "top"
-	// (as if doing it by hand)
+	// (as if doing it by hand); the result takes the sign of this
+	// unless the other magnitude wins, which also covers mixed-sign
+	// addition routed here from operator+
 	if (other.absGreaterThan(*this)) {
-		top = other;
-		bottom = BigInt(*this);
-		resultNeg = !top.neg;
+		top = &other;
+		bottom = this;
+		resultNeg = !this->neg;
 	}
 	else {
-		top = *this;
-		bottom = BigInt(other);
-		resultNeg = top.neg;
-	}
-	
-	short *resultArr = new short[tempLength];
-	short carry = 0;
-	short diff, topDigit, bottomDigit;
-
-	// subtract digits from right to left, carrying
-	// by adding one to the next "bottom" digit
-	for (int i = 0; i < tempLength; i++) {
-		// if we run out of digits in either number, use a 0
-		topDigit = (i < top.dataLength) ? top.data[i] : 0;
-		bottomDigit = (i < bottom.dataLength) ? bottom.data[i] : 0;
-		// carry along the "bottom" number
-		diff = topDigit - (bottomDigit + carry);
-		if (diff < 0) {
-			diff += 10;
-			carry = 1;
-		}
-		else {
-			carry = 0;
-		}
-
-		resultArr[i] = diff;
+		top = this;
+		bottom = &other;
+		resultNeg = top->neg;
 	}
 
-	// count the leading zeros in the difference
-	int leadingZeros = 0;
-	while (resultArr[(tempLength - leadingZeros) - 1] == 0) {
-		leadingZeros++;
-	}
-	if (leadingZeros == tempLength) {
-		// account for a difference of zero
-		leadingZeros--;
-		resultNeg = false;
-	}
+	BigInt result(top->dataLength, resultNeg);
+	limbs::sub(result.data, top->data, top->dataLength, bottom->data, bottom->dataLength);
 
-	return BigInt(tempLength - leadingZeros, resultArr, resultNeg);
+	// strip leading zeros and keep zero positive
+	result.trim();
+	return result;
 }
 
 // absolute value
@@ -284,41 +382,7 @@ BigInt BigInt::abs() const {
 
 // compare absolute values
 bool BigInt::absGreaterThan(BigInt const& other) const {
-	// compare length
-	if (this->dataLength > other.dataLength) {
-		return true;
-	}
-	if (other.dataLength > this->dataLength) {
-		return false;
-	}
-
-	// same length, so compare by digit (MSD first)
-	for (int i = this->dataLength - 1; i >= 0; i--) {
-		if (this->data[i] > other.data[i]) return true;
-		if (this->data[i] < other.data[i]) return false;
-	}
-
-	// abs vals are equal
-	return false;
-}
-
-// quickly multiply by 10
-BigInt BigInt::multBy10() const {
-	// check that this is non-zero
-	if (this->dataLength != 1 || *this != BigInt(0)) {
-		// copy to a new array with a zero added to the end
-		short *resultArr = new short[dataLength + 1];
-		resultArr[0] = 0;
-		for (int i = 0; i < dataLength; i++) {
-			resultArr[i + 1] = this->data[i];
-		}
-
-		return BigInt(dataLength + 1, resultArr, neg);
-	}
-	else {
-		// 0*10 = 0, so just return 0
-		return *this;
-	}
+	return limbs::cmp(this->data, this->dataLength, other.data, other.dataLength) > 0;
 }
 
 // helper for division/remainder
@@ -336,24 +400,24 @@ BigInt BigInt::divide(BigInt const& other, BigInt &remainder) const {
 	if (other == 0) {
 		if (*this == 0) {
 			// 0/0, return undefined
-			remainder = BigInt(-1, NULL, false);
-			return BigInt(-1, NULL, false);
+			remainder = BigInt(-1, false);
+			return BigInt(-1, false);
 		}
 		else {
 			// infinity/0, return infinity
 			remainder = BigInt(0);
-			return BigInt(0, NULL, neg);
+			return BigInt(0, neg);
 		}
 	}
 	// if infinity/infinity, return undefined
 	if (dataLength == 0 && other.dataLength == 0) {
-		remainder = BigInt(-1, NULL, false);
-		return BigInt(-1, NULL, false);
+		remainder = BigInt(-1, false);
+		return BigInt(-1, false);
 	}
 	// if infinity/number, return infinity
 	if (dataLength == 0) {
 		remainder = BigInt(0);
-		return BigInt(0, NULL, neg != other.neg);
+		return BigInt(0, neg != other.neg);
 	}
 	// if number/infinity, return 0
 	if (other.dataLength == 0) {
@@ -361,39 +425,30 @@ BigInt BigInt::divide(BigInt const& other, BigInt &remainder) const {
 		return BigInt(0);
 	}
 
-	short *resultArr = new short[dataLength];
-	remainder = BigInt(0);
 	bool resultNeg = (this->neg != other.neg);
-	// get absolute value for later comparisons
-	BigInt otherAbs = other.abs();
-
-	// do long division
-	for (int i = 0; i < dataLength; i++) {
-		// pull the next digit down from the dividend
-		remainder = remainder.multBy10();
-		remainder += BigInt(data[(dataLength - 1) - i]);
-		// count how many times divisor goes into remainder
-		int divisorCount = 0;
-		while (remainder >= otherAbs) {
-			remainder -= otherAbs;
-			divisorCount++;
-		}
-		// put the count into the quotient
-		resultArr[(dataLength - 1) - i] = divisorCount;
+
+	// if the divisor is larger, the quotient is zero
+	if (other.absGreaterThan(*this)) {
+		remainder = this->abs();
+		return BigInt(0);
 	}
 
-	// count the leading zeros in the quotient
-	int leadingZeros = 0;
-	while (resultArr[(dataLength - leadingZeros) - 1] == 0) {
-		leadingZeros++;
+	BigInt result(dataLength - other.dataLength + 1, resultNeg);
+	BigInt rem(other.dataLength, false);
+	if (other.dataLength == 1) {
+		// single-limb divisor, so divide in one pass
+		rem.data[0] = limbs::divmod1(result.data, data, dataLength, other.data[0]);
 	}
-	if (leadingZeros == dataLength) {
-		// account for a quotient of zero
-		leadingZeros--;
-		resultNeg = false;
+	else {
+		// do long division
+		limbs::divmod(result.data, rem.data, data, dataLength, other.data, other.dataLength);
 	}
 
-	return BigInt(dataLength - leadingZeros, resultArr, resultNeg);
+	// strip leading zeros and keep zero positive
+	rem.trim();
+	remainder = std::move(rem);
+	result.trim();
+	return result;
 }
 
 // binary addition
@@ -420,80 +475,326 @@ BigInt BigInt::operator-(BigInt const& other) const {
 
 // binary multiplication
 BigInt BigInt::operator*(BigInt const& other) const {
+	// x * x takes the squaring path
+	if (this == &other) return square();
+
 	// if either operand is undefined, return undefined
 	if (dataLength == -1) return *this;
 	if (other.dataLength == -1) return other;
 	// infinity * 0 = undefined
-	if ((dataLength == 0 && other == 0) || (*this == 0 && other.dataLength == 0)) return BigInt(-1, NULL, false);
+	if ((dataLength == 0 && other == 0) || (*this == 0 && other.dataLength == 0)) return BigInt(-1, false);
 	// infinity * (anything else) = infinity
-	if (dataLength == 0 || other.dataLength == 0) return BigInt(0, NULL, neg != other.neg);
+	if (dataLength == 0 || other.dataLength == 0) return BigInt(0, neg != other.neg);
 
 	// if either operand is zero, return zero
 	if (*this == 0) return *this;
 	if (other == 0) return other;
 
-	BigInt result(0), top = NULL, bottom = NULL;
-
-	// find the larger abs value and put it on "top"
-	// (as if we were doing mult by hand)
-	if (other.absGreaterThan(*this)) {
-		top = other;
-		bottom = BigInt(*this);
+	// multiply magnitudes into a fresh array
+	int tempLength = dataLength + other.dataLength;
+	BigInt result(tempLength, this->neg != other.neg);
+	if (dataLength >= other.dataLength) {
+		limbs::mul(result.data, data, dataLength, other.data, other.dataLength);
 	}
 	else {
-		top = *this;
-		bottom = BigInt(other);
+		limbs::mul(result.data, other.data, other.dataLength, data, dataLength);
 	}
 
-	// var to hold partial product
-	BigInt resultPartBig = BigInt(0);
+	result.trim();
+	return result;
+}
 
-	int carry, quot;
+// square (about half the limb products of a general multiply)
+BigInt BigInt::square() const {
+	// undefined stays undefined, and infinity squared is +infinity
+	if (dataLength == -1) return *this;
+	if (dataLength == 0) return BigInt(0, false);
 
-	// for each digit in "bottom" number, multiply it
-	// by the entire top number (adding zeros appropriately)
-	// and add that to our result
-	for (int j = 0; j < bottom.dataLength; j++) {
-		// reset the partial product BigInt
-		resultPartBig.dataLength = top.dataLength;
-		delete[] resultPartBig.data;
-#if DEBUG
-		printDebugDelete(resultPartBig.id);
-#endif
-		resultPartBig.data = new short[top.dataLength + 1];
-#if DEBUG
-		resultPartBig.id = nextId;
-		nextId++;
-		printDebugNew(resultPartBig.id);
-#endif
-		carry = 0;
-		// multiply next bottom digit by top BigInt
-		for (int i = 0; i < top.dataLength; i++) {
-			quot = bottom.data[j] * top.data[i] + carry;
-			if (quot > 9) {
-				carry = quot / 10;
-				quot %= 10;
-			}
-			else {
-				carry = 0;
+	BigInt result(2 * dataLength, false);
+	limbs::sqr(result.data, data, dataLength);
+	result.trim();
+	return result;
+}
+
+// negate the two's complement value high * 2^(64 n) + r in place
+static void negateWide(limbs::limb *r, int n, long &high) {
+	limbs::limb carry = 1;
+	for (int i = 0; i < n; i++) {
+		limbs::limb v = ~r[i] + carry;
+		carry = (carry && v == 0) ? 1 : 0;
+		r[i] = v;
+	}
+	high = -high - 1 + (long)carry;
+}
+
+// modular exponentiation
+BigInt BigInt::powMod(BigInt const& base, BigInt const& exp, BigInt const& mod) {
+	return Modulus(mod).powMod(base, exp);
+}
+
+// greatest common divisor
+BigInt BigInt::gcd(BigInt const& a, BigInt const& b) {
+	if (a.dataLength <= 0 || b.dataLength <= 0) return BigInt(-1, false);
+	if (a == 0) return b.abs();
+	if (b == 0) return a.abs();
+
+	int n = (a.dataLength < b.dataLength) ? a.dataLength : b.dataLength;
+	BigInt result(n, false);
+	int gn = limbs::gcd(result.data, a.data, a.dataLength, b.data, b.dataLength);
+	limbs::zero(result.data + gn, n - gn);
+	result.trim();
+	return result;
+}
+
+// least common multiple
+BigInt BigInt::lcm(BigInt const& a, BigInt const& b) {
+	if (a.dataLength <= 0 || b.dataLength <= 0) return BigInt(-1, false);
+	if (a == 0 || b == 0) return BigInt(0);
+	return a.abs() / gcd(a, b) * b.abs();
+}
+
+// extended gcd
+BigInt BigInt::extendedGcd(BigInt const& a, BigInt const& b, BigInt &x, BigInt &y) {
+	if (a.dataLength <= 0 || b.dataLength <= 0) {
+		x = BigInt(-1, false);
+		y = BigInt(-1, false);
+		return BigInt(-1, false);
+	}
+	if (b == 0) {
+		x = (a == 0) ? 0 : (a.neg ? -1 : 1);
+		y = 0;
+		return a.abs();
+	}
+	if (a == 0) {
+		x = 0;
+		y = b.neg ? -1 : 1;
+		return b.abs();
+	}
+
+	// |g| = cx |a| - cy |b| (or the negation, when flip is set)
+	BigInt g(a.dataLength < b.dataLength ? a.dataLength : b.dataLength, false);
+	BigInt cx(b.dataLength, false), cy(a.dataLength, false);
+	int xn, yn;
+	bool flip;
+	int gn = limbs::gcdext(g.data, cx.data, xn, cy.data, yn, flip, a.data, a.dataLength, b.data, b.dataLength);
+	limbs::zero(g.data + gn, g.dataLength - gn);
+	limbs::zero(cx.data + xn, cx.dataLength - xn);
+	limbs::zero(cy.data + yn, cy.dataLength - yn);
+	g.trim();
+	cx.trim();
+	cy.trim();
+	cx.neg = (flip != a.neg) && cx != 0;
+	cy.neg = (flip == b.neg) && cy != 0;
+	x = std::move(cx);
+	y = std::move(cy);
+	return g;
+}
+
+// modular inverse
+BigInt BigInt::modInverse(BigInt const& a, BigInt const& m) {
+	if (a.dataLength <= 0 || m.dataLength <= 0 || m == 0) return BigInt(-1, false);
+	BigInt mod = m.abs();
+	BigInt r = a % mod;
+	if (r == 0) return (mod == 1) ? BigInt(0) : BigInt(-1, false);
+
+	// r x + m y = 1 makes x (which lies in (-m, m)) the inverse
+	BigInt x = 0, y = 0;
+	BigInt g = extendedGcd(r, mod, x, y);
+	if (g != 1) return BigInt(-1, false);
+	if (x.neg) x += mod;
+	return x;
+}
+
+// product of a range
+BigInt BigInt::product(BigInt const *first, BigInt const *last) {
+	long count = last - first;
+	if (count <= 0) return BigInt(1);
+
+	// special values and zeros follow the rules of '*' one at a time
+	bool negative = false;
+	for (BigInt const *p = first; p != last; p++) {
+		if (p->dataLength <= 0 || *p == 0) {
+			BigInt result = *first;
+			for (p = first + 1; p != last; p++) {
+				result = result * *p;
 			}
-			resultPartBig.data[i] = quot;
+			return result;
+		}
+		if (p->neg) negative = !negative;
+	}
+
+	const limb **factors = new const limb *[count];
+	int *lengths = new int[count];
+	int total = 0;
+	for (long i = 0; i < count; i++) {
+		factors[i] = first[i].data;
+		lengths[i] = first[i].dataLength;
+		total += lengths[i];
+	}
+	BigInt result(total, negative);
+	result.dataLength = limbs::productMany(result.data, factors, lengths, (int)count);
+	delete[] factors;
+	delete[] lengths;
+	result.trim();
+	return result;
+}
+
+// product of a range of longs
+BigInt BigInt::product(long const *first, long const *last) {
+	long count = last - first;
+	if (count <= 0) return BigInt(1);
+
+	bool negative = false;
+	limb *factors = limbs::allocate((int)count);
+	for (long i = 0; i < count; i++) {
+		if (first[i] == 0) {
+			limbs::release(factors);
+			return BigInt(0);
+		}
+		if (first[i] < 0) negative = !negative;
+		// negate as unsigned so LONG_MIN survives
+		factors[i] = (first[i] < 0) ? (limb)0 - (limb)first[i] : (limb)first[i];
+	}
+	BigInt result((int)count, negative);
+	result.dataLength = limbs::product1(result.data, factors, (int)count);
+	limbs::release(factors);
+	result.trim();
+	return result;
+}
+
+// sum of a range
+BigInt BigInt::sum(BigInt const *first, BigInt const *last) {
+	Accumulator total;
+	for (BigInt const *p = first; p != last; p++) {
+		total += *p;
+	}
+	return total.result();
+}
+
+// n!
+BigInt BigInt::factorial(long n) {
+	if (n < 0) return BigInt(-1, false);
+	int rn;
+	limb *r = limbs::factorial((unsigned long)n, rn);
+	return adopt(r, rn);
+}
+
+// binomial coefficient
+BigInt BigInt::binomial(long n, long k) {
+	if (n < 0) return BigInt(-1, false);
+	if (k < 0 || k > n) return BigInt(0);
+	int rn;
+	limb *r = limbs::binomial((unsigned long)n, (unsigned long)k, rn);
+	return adopt(r, rn);
+}
+
+// primorial
+BigInt BigInt::primorial(long n) {
+	int rn;
+	limb *r = limbs::primorial((n < 0) ? 0 : (unsigned long)n, rn);
+	return adopt(r, rn);
+}
+
+// true if the term takes away from the total
+bool BigInt::Term::subtracts() const {
+	return negate != (a->neg != (b != NULL && b->neg));
+}
+
+// sum of n terms, each +/- a or +/- a * b. The terms are added into
+// one array of two's complement limbs wide enough for any partial
+// sum, with an overflow count above it, and the sign is sorted out
+// at the end; only products after the first need scratch space
+BigInt BigInt::fusedSum(Term const *terms, int n) {
+	if (n == 0) return BigInt(0);
+
+	// special values take the ordinary operators
+	int len = 0, scratchLength = 0;
+	bool special = false;
+	for (int i = 0; i < n; i++) {
+		int termLength = terms[i].a->dataLength;
+		if (terms[i].b != NULL) {
+			if (terms[i].b->dataLength <= 0) special = true;
+			termLength += terms[i].b->dataLength;
+			if (i > 0 && termLength > scratchLength) scratchLength = termLength;
 		}
-		if (carry > 0) {
-			// account for possible extra carry
-			resultPartBig.data[top.dataLength] = carry;
-			resultPartBig.dataLength++;
+		if (terms[i].a->dataLength <= 0) special = true;
+		if (termLength > len) len = termLength;
+	}
+	if (special) {
+		BigInt result(0);
+		for (int i = 0; i < n; i++) {
+			BigInt term = (terms[i].b != NULL) ? *terms[i].a * *terms[i].b : *terms[i].a;
+			result = terms[i].negate ? result - term : result + term;
+		}
+		return result;
+	}
+
+	// one spare limb absorbs the carries of up to 2^64 terms
+	len++;
+	BigInt result(len, false);
+	limb *scratch = (scratchLength > 0) ? limbs::allocate(scratchLength) : NULL;
+	long high = 0;
+
+	// the sum is built with the first term's sign taken out, so it
+	// always starts positive; 'flip' puts the sign back at the end
+	bool flip = terms[0].subtracts();
+	int i = 0;
+	if (n >= 2 && terms[0].b == NULL && terms[1].b == NULL && terms[1].subtracts() == flip) {
+		// two plain terms of the same sign: one pass adds them
+		BigInt const *a = terms[0].a, *b = terms[1].a;
+		if (a->dataLength < b->dataLength) {
+			BigInt const *t = a;
+			a = b;
+			b = t;
+		}
+		result.data[a->dataLength] = limbs::add(result.data, a->data, a->dataLength, b->data, b->dataLength);
+		limbs::zero(result.data + a->dataLength + 1, len - a->dataLength - 1);
+		i = 2;
+	}
+	for (; i < n; i++) {
+		BigInt const *a = terms[i].a, *b = terms[i].b;
+		bool subtract = terms[i].subtracts() != flip;
+		if (b != NULL && a->dataLength < b->dataLength) {
+			BigInt const *t = a;
+			a = b;
+			b = t;
 		}
 
-		// add zeros to the end of our partial product appropriately
-		for (int times10count = 0; times10count < j; times10count++) {
-			resultPartBig = resultPartBig.multBy10();
+		if (i == 0) {
+			// the first term goes straight into the result
+			int used = a->dataLength;
+			if (b != NULL) {
+				used += b->dataLength;
+				limbs::mul(result.data, a->data, a->dataLength, b->data, b->dataLength);
+			}
+			else {
+				limbs::copy(result.data, a->data, used);
+			}
+			limbs::zero(result.data + used, len - used);
+			continue;
 		}
 
-		result += resultPartBig;
+		const limb *m = a->data;
+		int mn = a->dataLength;
+		if (b != NULL) {
+			mn += b->dataLength;
+			limbs::mul(scratch, a->data, a->dataLength, b->data, b->dataLength);
+			m = scratch;
+		}
+		if (subtract) {
+			high -= (long)limbs::subFrom(result.data, len, m, mn);
+		}
+		else {
+			high += (long)limbs::addTo(result.data, len, m, mn);
+		}
 	}
+	if (scratch != NULL) limbs::release(scratch);
 
-	result.neg = (this->neg != other.neg);
+	// the total fits in len limbs, so high is now 0 or -1
+	bool negative = (high < 0);
+	if (negative) negateWide(result.data, len, high);
+	result.neg = (negative != flip);
+	result.trim();
 	return result;
 }
 
@@ -512,49 +813,462 @@ BigInt BigInt::operator%(BigInt const& other) const {
 	return remainder;
 }
 
+// division by a prepared divisor
+BigInt BigInt::operator/(Divisor const& other) const {
+	// special values and zero take the ordinary path
+	if (other.inverse == NULL || dataLength <= 0) return *this / other.value;
+	if (other.value.absGreaterThan(*this)) return BigInt(0);
+
+	int n = other.value.dataLength;
+	BigInt result(dataLength - n + 1, neg != other.value.neg);
+	limb *rem = limbs::allocate(n);
+	limbs::divmodPre(*other.inverse, result.data, rem, data, dataLength);
+	limbs::release(rem);
+	result.trim();
+	return result;
+}
+
+// remainder by a prepared divisor
+BigInt BigInt::operator%(Divisor const& other) const {
+	if (other.inverse == NULL || dataLength <= 0) return *this % other.value;
+	if (other.value.absGreaterThan(*this)) return abs();
+
+	BigInt remainder(other.value.dataLength, false);
+	limbs::modPre(*other.inverse, remainder.data, data, dataLength);
+	remainder.trim();
+	return remainder;
+}
+
+/*****************************************************************
+ * in-place updates
+ *
+ * The compound operators work on this number's own array whenever
+ * the operands are plain numbers: sums and single-limb products
+ * and quotients are computed where the value already lives, and
+ * the array only grows (with headroom) when the result needs more
+ * room. General products need the old value as an operand, so they
+ * work from a scratch copy, and general division still goes through
+ * the ordinary operators. Special values, and a number combined
+ * with itself, also take the ordinary operators.
+ *
+ *****************************************************************/
+
+// add a signed magnitude in place
+void BigInt::addMagnitude(const limb *m, int mn, bool mNeg) {
+	if (neg == mNeg) {
+		// same signs: add magnitudes, widening with zeros first
+		int top = (dataLength > mn) ? dataLength : mn;
+		growData(top + 1);
+		if (dataLength < top) limbs::zero(data + dataLength, top - dataLength);
+		dataLength = top;
+		limb carry = limbs::addTo(data, top, m, mn);
+		if (carry != 0) data[dataLength++] = carry;
+	}
+	else if (limbs::cmp(data, dataLength, m, mn) >= 0) {
+		// this has the larger magnitude and keeps its sign
+		limbs::subFrom(data, dataLength, m, mn);
+		trimLength();
+	}
+	else {
+		// m has the larger magnitude and gives the sign
+		growData(mn);
+		limbs::zero(data + dataLength, mn - dataLength);
+		limbs::sub(data, m, mn, data, mn);
+		dataLength = mn;
+		neg = mNeg;
+		trimLength();
+	}
+}
+
+// multiply by a signed limb in place
+void BigInt::mulLimb(limb m, bool mNeg) {
+	// grow only for a carry out of the top limb, so a product that
+	// still fits inline stays there
+	limb high = limbs::mul1(data, data, dataLength, m);
+	if (high != 0) {
+		growData(dataLength + 1);
+		data[dataLength++] = high;
+	}
+	neg = (neg != mNeg);
+	// trimming also makes a zero product positive
+	trimLength();
+}
+
+// divide by a signed limb in place
+void BigInt::divLimb(limb d, bool dNeg) {
+	limbs::divmod1(data, data, dataLength, d);
+	neg = (neg != dNeg);
+	trimLength();
+}
+
 // compound addition-assignment operator
-BigInt BigInt::operator+=(BigInt const& other) {
-	return *this = *this + other;
+BigInt& BigInt::operator+=(BigInt const& other) {
+	if (dataLength <= 0 || other.dataLength <= 0 || this == &other) return *this = *this + other;
+	addMagnitude(other.data, other.dataLength, other.neg);
+	return *this;
 }
 
 // compound subtraction-assignment operator
-BigInt BigInt::operator-=(BigInt const& other) {
-	return *this = *this - other;
+BigInt& BigInt::operator-=(BigInt const& other) {
+	if (dataLength <= 0 || other.dataLength <= 0 || this == &other) return *this = *this - other;
+	addMagnitude(other.data, other.dataLength, !other.neg);
+	return *this;
 }
 
+// an in-place product reads this value from a copy kept in a
+// per-thread heap array, reused from one call to the next so that a
+// warmed-up loop does not allocate; arrays beyond MUL_SCRATCH_LIMBS
+// are not kept, as such a product costs far more than the allocation
+static const int MUL_SCRATCH_LIMBS = 1 << 16;
+
+struct MulScratch {
+	limbs::limb *p;
+	int n;
+
+	MulScratch() : p(NULL), n(0) {}
+
+	~MulScratch() {
+		if (p != NULL) limbs::release(p);
+	}
+};
+
+static thread_local MulScratch mulScratch;
+
 // compound multiplication-assignment operator
-BigInt BigInt::operator*=(BigInt const& other) {
-	return *this = *this * other;
+BigInt& BigInt::operator*=(BigInt const& other) {
+	if (dataLength <= 0 || other.dataLength <= 0) return *this = *this * other;
+	if (other.dataLength == 1 && this != &other) {
+		mulLimb(other.data[0], other.neg);
+		return *this;
+	}
+
+	int n = dataLength;
+	int productLength = n + other.dataLength;
+	limb *r = data;
+	limb *a = data;
+	if (productLength > dataCapacity) {
+		// build the product straight into a bigger array, with the
+		// same headroom as growData(), and let the old one go after
+		int newCapacity = dataCapacity + dataCapacity / 2;
+		if (newCapacity < productLength) newCapacity = productLength;
+		r = limbs::allocate(newCapacity);
+		dataCapacity = newCapacity;
+	}
+	else if (n <= MUL_SCRATCH_LIMBS) {
+		// the product overwrites this value, so multiply from a copy
+		if (n > mulScratch.n) {
+			if (mulScratch.p != NULL) limbs::release(mulScratch.p);
+			mulScratch.n = n + n / 2;
+			if (mulScratch.n > MUL_SCRATCH_LIMBS) mulScratch.n = MUL_SCRATCH_LIMBS;
+			mulScratch.p = limbs::allocateHeap(mulScratch.n);
+		}
+		a = mulScratch.p;
+		limbs::copy(a, data, n);
+	}
+	else {
+		a = limbs::allocate(n);
+		limbs::copy(a, data, n);
+	}
+
+	if (this == &other) {
+		limbs::sqr(r, a, n);
+	}
+	else if (n >= other.dataLength) {
+		limbs::mul(r, a, n, other.data, other.dataLength);
+	}
+	else {
+		limbs::mul(r, other.data, other.dataLength, a, n);
+	}
+
+	if (r != data) {
+		// the old array (or inline buffer) is done with
+		if (data != inlineData) {
+			limbs::release(data);
+#if DEBUG
+			printDebugDelete(id);
+#endif
+		}
+		data = r;
+#if DEBUG
+		id = nextId++;
+		printDebugNew(id);
+#endif
+	}
+	else if (a != mulScratch.p) {
+		limbs::release(a);
+	}
+	dataLength = productLength;
+	neg = (neg != other.neg);
+	trimLength();
+	return *this;
 }
 
 // compound division-assignment operator
-BigInt BigInt::operator/=(BigInt const& other) {
+BigInt& BigInt::operator/=(BigInt const& other) {
+	if (dataLength > 0 && other.dataLength == 1 && other.data[0] != 0 && this != &other) {
+		divLimb(other.data[0], other.neg);
+		return *this;
+	}
 	return *this = *this / other;
 }
 
 // compound mod-assignment operator
-BigInt BigInt::operator%=(BigInt const& other) {
+BigInt& BigInt::operator%=(BigInt const& other) {
+	if (dataLength > 0 && other.dataLength == 1 && other.data[0] != 0 && this != &other) {
+		data[0] = limbs::mod1(data, dataLength, other.data[0]);
+		dataLength = 1;
+		neg = false;
+		return *this;
+	}
 	return *this = *this % other;
 }
 
+// bits of magnitude the array can hold
+long BigInt::capacity() const {
+	return (long)dataCapacity * 64;
+}
+
+// make room for the given number of bits up front
+void BigInt::reserve(long bits) {
+	long n = (bits + 63) / 64;
+	if (n > dataCapacity) moveData((int)n);
+}
+
+// drop spare room
+void BigInt::shrink_to_fit() {
+	if (data == NULL || data == inlineData) return;
+	if (dataLength <= 0) {
+		// special values need no array at all
+		releaseData();
+	}
+	else if (dataLength <= INLINE_LIMBS) {
+		trim();
+	}
+	else if (dataLength < dataCapacity) {
+		moveData(dataLength);
+	}
+}
+
+// add or subtract one from the magnitude in place
+void BigInt::stepMagnitude(bool up) {
+	const limb one = 1;
+	if (!up) {
+		// the magnitude is at least one, so nothing is borrowed out
+		limbs::subFrom(data, dataLength, &one, 1);
+		trimLength();
+	}
+	else if (limbs::addTo(data, dataLength, &one, 1) != 0) {
+		// carried out of the top limb: the magnitude is now exactly
+		// 2^(64 * dataLength), which needs one more limb
+		growData(dataLength + 1);
+		data[dataLength++] = 1;
+	}
+}
+
 // prefix '++' operator
-BigInt BigInt::operator++() {
-	return *this = *this + BigInt(1);
+BigInt& BigInt::operator++() {
+	// infinity and undefined are unchanged
+	if (dataLength > 0) stepMagnitude(!neg);
+	return *this;
 }
 
-// postfix '++' operator
+// postfix '++' operator (returns the value before incrementing)
 BigInt BigInt::operator++(int dummy) {
-	return *this = *this + BigInt(1);
+	BigInt old = *this;
+	++*this;
+	return old;
 }
 
 // prefix '--' operator
-BigInt BigInt::operator--() {
-	return *this = *this - BigInt(1);
+BigInt& BigInt::operator--() {
+	// infinity and undefined are unchanged; zero goes to -1
+	if (dataLength > 0) {
+		if (*this == 0) {
+			data[0] = 1;
+			neg = true;
+		}
+		else {
+			stepMagnitude(neg);
+		}
+	}
+	return *this;
 }
 
-// postfix '--' operator
+// postfix '--' operator (returns the value before decrementing)
 BigInt BigInt::operator--(int dummy) {
-	return *this = *this - BigInt(1);
+	BigInt old = *this;
+	--*this;
+	return old;
+}
+
+/*****************************************************************
+ * mixed-type operators where the right operand is a long
+ *
+ * These use single-limb kernels directly on this number's limbs,
+ * so each is one linear pass with no temporary BigInt. Infinity
+ * and undefined values take the general path so the special-value
+ * rules live in one place.
+ *****************************************************************/
+
+// this + (mNeg ? -m : m)
+BigInt BigInt::addLimb(limb m, bool mNeg) const {
+	if (neg == mNeg || m == 0) {
+		// same signs, so add magnitudes
+		BigInt result(dataLength + 1, neg);
+		result.data[dataLength] = limbs::add(result.data, data, dataLength, &m, 1);
+		result.trim();
+		return result;
+	}
+	if (dataLength == 1 && data[0] < m) {
+		// m has the larger magnitude and gives the sign
+		BigInt result(1, mNeg);
+		result.data[0] = m - data[0];
+		return result;
+	}
+	// this has the larger magnitude and keeps its sign
+	BigInt result(dataLength, neg);
+	limbs::sub(result.data, data, dataLength, &m, 1);
+	result.trim();
+	return result;
+}
+
+// magnitude of a long as a limb (safe for LONG_MIN)
+static inline uint64_t longMagnitude(long num) {
+	return (num < 0) ? (uint64_t)0 - (uint64_t)num : (uint64_t)num;
+}
+
+// binary addition with a long
+BigInt BigInt::operator+(long num) const {
+	if (dataLength <= 0) return *this + BigInt(num);
+	return addLimb(longMagnitude(num), num < 0);
+}
+
+// binary subtraction with a long
+BigInt BigInt::operator-(long num) const {
+	if (dataLength <= 0) return *this - BigInt(num);
+	return addLimb(longMagnitude(num), num > 0);
+}
+
+// binary multiplication with a long
+BigInt BigInt::operator*(long num) const {
+	if (dataLength <= 0) return *this * BigInt(num);
+	if (dataLength == INLINE_LIMBS) {
+		// find the carry first, so a product that still fits inline
+		// does not go through a heap array
+		limb product[INLINE_LIMBS + 1];
+		product[INLINE_LIMBS] = limbs::mul1(product, data, INLINE_LIMBS, longMagnitude(num));
+		BigInt result((product[INLINE_LIMBS] == 0) ? INLINE_LIMBS : INLINE_LIMBS + 1, neg != (num < 0));
+		limbs::copy(result.data, product, result.dataLength);
+		result.trim();
+		return result;
+	}
+	BigInt result(dataLength + 1, neg != (num < 0));
+	result.data[dataLength] = limbs::mul1(result.data, data, dataLength, longMagnitude(num));
+	// trimming also makes a zero product positive
+	result.trim();
+	return result;
+}
+
+// binary division with a long
+BigInt BigInt::operator/(long num) const {
+	if (dataLength <= 0 || num == 0) return *this / BigInt(num);
+	BigInt result(dataLength, neg != (num < 0));
+	limbs::divmod1(result.data, data, dataLength, longMagnitude(num));
+	result.trim();
+	return result;
+}
+
+// binary mod with a long (like the general remainder, |this| mod |num|)
+BigInt BigInt::operator%(long num) const {
+	if (dataLength <= 0 || num == 0) return *this % BigInt(num);
+	BigInt result(1, false);
+	result.data[0] = limbs::mod1(data, dataLength, longMagnitude(num));
+	return result;
+}
+
+// compound addition-assignment with a long
+BigInt& BigInt::operator+=(long num) {
+	if (dataLength <= 0) return *this = *this + num;
+	limb m = longMagnitude(num);
+	addMagnitude(&m, 1, num < 0);
+	return *this;
+}
+
+// compound subtraction-assignment with a long
+BigInt& BigInt::operator-=(long num) {
+	if (dataLength <= 0) return *this = *this - num;
+	limb m = longMagnitude(num);
+	addMagnitude(&m, 1, num > 0);
+	return *this;
+}
+
+// compound multiplication-assignment with a long
+BigInt& BigInt::operator*=(long num) {
+	if (dataLength <= 0) return *this = *this * num;
+	mulLimb(longMagnitude(num), num < 0);
+	return *this;
+}
+
+// compound division-assignment with a long
+BigInt& BigInt::operator/=(long num) {
+	if (dataLength <= 0 || num == 0) return *this = *this / num;
+	divLimb(longMagnitude(num), num < 0);
+	return *this;
+}
+
+// compound mod-assignment with a long
+BigInt& BigInt::operator%=(long num) {
+	if (dataLength <= 0 || num == 0) return *this = *this % num;
+	data[0] = limbs::mod1(data, dataLength, longMagnitude(num));
+	dataLength = 1;
+	neg = false;
+	return *this;
+}
+
+// compare a number with a long
+int BigInt::compareLong(long num) const {
+	// different signs (zero is always positive)
+	if (neg != (num < 0)) return neg ? -1 : 1;
+
+	// same sign, so compare magnitudes
+	limb m = longMagnitude(num);
+	int c = (dataLength > 1 || data[0] > m) ? 1 : (data[0] < m) ? -1 : 0;
+	return neg ? -c : c;
+}
+
+// equality operator with a long
+bool BigInt::operator==(long num) const {
+	if (dataLength <= 0) return *this == BigInt(num);
+	return compareLong(num) == 0;
+}
+
+// inequality operator with a long
+bool BigInt::operator!=(long num) const {
+	return !(*this == num);
+}
+
+// greater-than operator with a long
+bool BigInt::operator>(long num) const {
+	if (dataLength <= 0) return *this > BigInt(num);
+	return compareLong(num) > 0;
+}
+
+// greater-than-or-equal operator with a long
+bool BigInt::operator>=(long num) const {
+	if (dataLength <= 0) return *this >= BigInt(num);
+	return compareLong(num) >= 0;
+}
+
+// less-than operator with a long
+bool BigInt::operator<(long num) const {
+	if (dataLength <= 0) return *this < BigInt(num);
+	return compareLong(num) < 0;
+}
+
+// less-than-or-equal operator with a long
+bool BigInt::operator<=(long num) const {
+	if (dataLength <= 0) return *this <= BigInt(num);
+	return compareLong(num) <= 0;
 }
 
 
@@ -584,13 +1298,9 @@ bool BigInt::operator==(BigInt const& other) const {
 	// same lengths, so check signs
 	if (this->neg != other.neg) return false;
 
-	// same signs, so compare digits
-	for (int i = 0; i < this->dataLength; i++) {
-		if (this->data[i] != other.data[i]) return false;
-	}
-
-	// numbers are equal
-	return true;
+	// same signs, so compare digits (infinity and undefined have none)
+	if (this->dataLength <= 0) return true;
+	return limbs::cmp(this->data, this->dataLength, other.data, other.dataLength) == 0;
 }
 
 // inequality operator
@@ -613,14 +1323,10 @@ bool BigInt::operator>(BigInt const& other) const {
 		return bothNeg ? true : false;
 	}
 
-	// same sign, same length, so compare by digit (MSD first)
-	for (int i = this->dataLength - 1; i >= 0; i--) {
-		if (this->data[i] > other.data[i]) return true;
-		if (this->data[i] < other.data[i]) return false;
-	}
-
-	// numbers are equal
-	return false;
+	// same sign, same length, so compare by limb (MSD first)
+	if (this->dataLength <= 0) return false;
+	int c = limbs::cmp(this->data, this->dataLength, other.data, other.dataLength);
+	return bothNeg ? (c < 0) : (c > 0);
 }
 
 // greater-than-or-equal operator
@@ -643,14 +1349,10 @@ bool BigInt::operator<(BigInt const& other) const {
 		return bothNeg ? false : true;
 	}
 
-	// same sign, same length, so compare by digit (MSD first)
-	for (int i = this->dataLength - 1; i >= 0; i--) {
-		if (this->data[i] > other.data[i]) return false;
-		if (this->data[i] < other.data[i]) return true;
-	}
-
-	// numbers are equal
-	return false;
+	// same sign, same length, so compare by limb (MSD first)
+	if (this->dataLength <= 0) return false;
+	int c = limbs::cmp(this->data, this->dataLength, other.data, other.dataLength);
+	return bothNeg ? (c > 0) : (c < 0);
 }
 
 // less-than-or-equal operator
@@ -669,11 +1371,476 @@ ostream & operator<<(ostream& os, const BigInt& num) {
 			os << "INFINITY";
 		}
 		else {
-			// print each digit
-			for (int i = num.dataLength - 1; i >= 0; i--) {
-				os << (short)num.data[i];
-			}
+			char *digits = new char[20 * num.dataLength];
+			int len = limbs::toDecimal(digits, num.data, num.dataLength);
+			os.write(digits, len);
+			delete[] digits;
 		}
 	}
 	return os;
 }
+
+// input-stream operator for BigInt (non-member function)
+istream & operator>>(istream& is, BigInt& num) {
+	// skip leading whitespace
+	istream::sentry sentry(is);
+	if (!sentry) return is;
+
+	// collect the longest prefix that can form a number: a sign, a
+	// hex prefix after a leading zero, then digits
+	string text;
+	int c = is.peek();
+	if (c == '+' || c == '-') {
+		text += (char)is.get();
+		c = is.peek();
+	}
+	bool hex = false;
+	if (c == '0') {
+		text += (char)is.get();
+		c = is.peek();
+		if (c == 'x' || c == 'X') {
+			text += (char)is.get();
+			hex = true;
+			c = is.peek();
+		}
+	}
+	// peek only after taking a character: peeking again once the end
+	// has been seen would set failbit on a number like "0"
+	while (c != EOF && isDigit((char)c, hex)) {
+		text += (char)is.get();
+		c = is.peek();
+	}
+
+	// text that is not a number reads as undefined
+	num = BigInt(text);
+	if (num.dataLength == -1) is.setstate(ios::failbit);
+	return is;
+}
+
+/*****************************************************************
+ * allocator hook and BigInt::Arena
+ *
+ *****************************************************************/
+
+// install a new allocator for this thread
+BigInt::Allocator *BigInt::setAllocator(Allocator *alloc) {
+	return limbs::setAllocator(alloc);
+}
+
+// the arena proper: a chain of heap blocks, each carved up from the
+// bottom. Requests too big for a standard block get a block of their
+// own, so arrays never straddle blocks
+struct BigInt::Arena::Impl : public limbs::Allocator {
+	static const int BLOCK_LIMBS = 8192; // standard block size
+	static const int LINK_LIMBS = 2; // block header, keeps alignment
+
+	limb *blocks; // most recent block; its first limb links the rest
+	limb *top; // next free limb in the most recent block
+	limb *end; // end of the most recent block
+	limbs::Allocator *previous; // allocator to restore afterwards
+
+	Impl() : blocks(NULL), top(NULL), end(NULL), previous(NULL) {}
+
+	~Impl() {
+		while (blocks != NULL) {
+			limb *next = (limb *)(uintptr_t)blocks[0];
+			delete[] blocks;
+			blocks = next;
+		}
+	}
+
+	limb *allocate(int n) {
+		if (top == NULL || end - top < n) {
+			int size = (n > BLOCK_LIMBS - LINK_LIMBS) ? n + LINK_LIMBS : BLOCK_LIMBS;
+			limb *block = new limb[size];
+			block[0] = (limb)(uintptr_t)blocks;
+			blocks = block;
+			top = block + LINK_LIMBS;
+			end = block + size;
+		}
+		limb *p = top;
+		top += n;
+		return p;
+	}
+
+	void release(limb *p, int n) {
+		// only the most recent array can be given back early; the rest
+		// wait for the arena to go away
+		if (p + n == top) top = p;
+	}
+};
+
+// constructor: install a fresh arena
+BigInt::Arena::Arena() : impl(new Impl) {
+	impl->previous = limbs::setAllocator(impl);
+}
+
+// destructor: restore the previous allocator and free the blocks
+BigInt::Arena::~Arena() {
+	limbs::setAllocator(impl->previous);
+	delete impl;
+}
+
+// copy a value out of the arena
+BigInt BigInt::Arena::keep(BigInt const& value) const {
+	limbs::Allocator *current = limbs::setAllocator(impl->previous);
+	BigInt result(value);
+	limbs::setAllocator(current);
+	return result;
+}
+
+/*****************************************************************
+ * thread pool and BigInt::Concurrency
+ *
+ *****************************************************************/
+
+// resize the pool shared by large multiplications
+int BigInt::setThreads(int n) {
+	return limbs::setThreads(n);
+}
+
+// constructor: install the limit
+BigInt::Concurrency::Concurrency(int threads) {
+	previous = limbs::setConcurrency((threads < 1) ? 1 : threads);
+}
+
+// destructor: restore the previous limit
+BigInt::Concurrency::~Concurrency() {
+	limbs::setConcurrency(previous);
+}
+
+/*****************************************************************
+ * BigInt::Accumulator
+ *
+ *****************************************************************/
+
+// counts grow by at most one per value added, so resolving them
+// this often keeps them well inside a limb
+static const long RESOLVE_INTERVAL = 1L << 62;
+
+// constructor: an empty total
+BigInt::Accumulator::Accumulator() : special(0), hasSpecial(false) {
+	Part empty = {NULL, NULL, 0, 0, 0};
+	positive = empty;
+	negative = empty;
+}
+
+// destructor: free both parts
+BigInt::Accumulator::~Accumulator() {
+	Part *parts[2] = {&positive, &negative};
+	for (int i = 0; i < 2; i++) {
+		if (parts[i]->sum != NULL) {
+			limbs::release(parts[i]->sum);
+			limbs::release(parts[i]->carry);
+		}
+	}
+}
+
+// move a part to bigger arrays (with headroom) if it needs them
+void BigInt::Accumulator::grow(Part &part, int n) {
+	if (n <= part.capacity) return;
+	int newCapacity = part.capacity + part.capacity / 2;
+	if (newCapacity < n) newCapacity = n;
+
+	limb *sum = limbs::allocate(newCapacity);
+	limb *carry = limbs::allocate(newCapacity + 1);
+	if (part.sum != NULL) {
+		limbs::copy(sum, part.sum, part.length);
+		limbs::copy(carry, part.carry, part.length + 1);
+		limbs::release(part.sum);
+		limbs::release(part.carry);
+	}
+	else {
+		carry[0] = 0;
+	}
+	part.sum = sum;
+	part.carry = carry;
+	part.capacity = newCapacity;
+}
+
+// add a magnitude without propagating carries
+void BigInt::Accumulator::addTo(Part &part, const limb *a, int n) {
+	if (n > part.length) {
+		grow(part, n);
+		limbs::zero(part.sum + part.length, n - part.length);
+		limbs::zero(part.carry + part.length + 1, n - part.length);
+		part.length = n;
+	}
+	limbs::addCarrySave(part.sum, part.carry, a, n);
+	if (++part.adds == RESOLVE_INTERVAL) resolve(part);
+}
+
+// fold the carry counts in, widening the part for a carry out
+void BigInt::Accumulator::resolve(Part &part) {
+	if (part.length == 0) return;
+	limb top = limbs::carrySaveResolve(part.sum, part.carry, part.length);
+	part.adds = 0;
+	if (top != 0) {
+		grow(part, part.length + 1);
+		part.sum[part.length] = top;
+		part.length++;
+		part.carry[part.length] = 0;
+	}
+}
+
+// add a value
+BigInt::Accumulator& BigInt::Accumulator::operator+=(BigInt const& value) {
+	if (value.dataLength <= 0) {
+		special = hasSpecial ? special + value : value;
+		hasSpecial = true;
+	}
+	else {
+		addTo(value.neg ? negative : positive, value.data, value.dataLength);
+	}
+	return *this;
+}
+
+// subtract a value
+BigInt::Accumulator& BigInt::Accumulator::operator-=(BigInt const& value) {
+	if (value.dataLength <= 0) {
+		special = hasSpecial ? special - value : -value;
+		hasSpecial = true;
+	}
+	else {
+		addTo(value.neg ? positive : negative, value.data, value.dataLength);
+	}
+	return *this;
+}
+
+// resolve both parts and take the negative one off the positive one
+BigInt BigInt::Accumulator::result() {
+	// any infinite or undefined value decides the total
+	if (hasSpecial) return special;
+
+	resolve(positive);
+	resolve(negative);
+	const limb zero = 0;
+	const limb *p = &zero, *q = &zero;
+	int pn = 1, qn = 1;
+	if (positive.length > 0) {
+		p = positive.sum;
+		pn = limbs::normalize(p, positive.length);
+	}
+	if (negative.length > 0) {
+		q = negative.sum;
+		qn = limbs::normalize(q, negative.length);
+	}
+
+	bool resultNeg = (limbs::cmp(p, pn, q, qn) < 0);
+	if (resultNeg) {
+		const limb *t = p;
+		p = q;
+		q = t;
+		int tn = pn;
+		pn = qn;
+		qn = tn;
+	}
+	BigInt total(pn, resultNeg);
+	limbs::sub(total.data, p, pn, q, qn);
+	total.trim();
+	return total;
+}
+
+// back to zero
+void BigInt::Accumulator::clear() {
+	positive.length = 0;
+	positive.adds = 0;
+	negative.length = 0;
+	negative.adds = 0;
+	special = 0;
+	hasSpecial = false;
+}
+
+/*****************************************************************
+ * BigInt::Modulus
+ *****************************************************************/
+
+// precompute the constants for arithmetic modulo |m|
+BigInt::Modulus::Modulus(BigInt const& m) : value(m.abs()), reducer(NULL) {
+	if (m.dataLength > 0 && m != 0) {
+		reducer = new limbs::ModReducer;
+		limbs::modInit(*reducer, value.data, value.dataLength);
+	}
+}
+
+BigInt::Modulus::~Modulus() {
+	if (reducer != NULL) {
+		limbs::modFree(*reducer);
+		delete reducer;
+	}
+}
+
+// |a| mod m into r
+void BigInt::Modulus::load(limb *r, BigInt const& a) const {
+	limbs::modReduce(*reducer, r, a.data, a.dataLength);
+}
+
+// a residue as a BigInt
+BigInt BigInt::Modulus::result(const limb *r) const {
+	BigInt x(reducer->n, false);
+	limbs::copy(x.data, r, reducer->n);
+	x.trim();
+	return x;
+}
+
+// false if m is unusable or either operand is special
+bool BigInt::Modulus::usable(BigInt const& a, BigInt const& b) const {
+	return reducer != NULL && a.dataLength > 0 && b.dataLength > 0;
+}
+
+// the modulus
+BigInt const& BigInt::Modulus::modulus() const {
+	return value;
+}
+
+// |a| mod m
+BigInt BigInt::Modulus::reduce(BigInt const& a) const {
+	if (!usable(a, a)) return BigInt(-1, false);
+	limb *r = limbs::allocate(reducer->n);
+	load(r, a);
+	BigInt x = result(r);
+	limbs::release(r);
+	return x;
+}
+
+// (a + b) mod m
+BigInt BigInt::Modulus::addMod(BigInt const& a, BigInt const& b) const {
+	if (!usable(a, b)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(2 * n), *rb = ra + n;
+	load(ra, a);
+	load(rb, b);
+	limb carry = limbs::add(ra, ra, n, rb, n);
+	if (carry != 0 || limbs::cmp(ra, n, reducer->m, n) >= 0) {
+		limbs::sub(ra, ra, n, reducer->m, n);
+	}
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+// (a - b) mod m
+BigInt BigInt::Modulus::subMod(BigInt const& a, BigInt const& b) const {
+	if (!usable(a, b)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(2 * n), *rb = ra + n;
+	load(ra, a);
+	load(rb, b);
+	if (limbs::sub(ra, ra, n, rb, n) != 0) {
+		limbs::add(ra, ra, n, reducer->m, n);
+	}
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+// (a * b) mod m
+BigInt BigInt::Modulus::mulMod(BigInt const& a, BigInt const& b) const {
+	if (!usable(a, b)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(2 * n + limbs::modScratch(n)), *rb = ra + n, *tp = rb + n;
+	load(ra, a);
+	load(rb, b);
+	// in Montgomery form the product comes out divided by R, which a
+	// second multiplication by R^2 mod m puts back
+	limbs::modMul(*reducer, ra, ra, rb, tp);
+	if (reducer->montgomery) limbs::modMul(*reducer, ra, ra, reducer->r2, tp);
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+// a^2 mod m
+BigInt BigInt::Modulus::sqrMod(BigInt const& a) const {
+	if (!usable(a, a)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(n + limbs::modScratch(n)), *tp = ra + n;
+	load(ra, a);
+	limbs::modMul(*reducer, ra, ra, ra, tp);
+	if (reducer->montgomery) limbs::modMul(*reducer, ra, ra, reducer->r2, tp);
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+// base^exp mod m
+BigInt BigInt::Modulus::powMod(BigInt const& base, BigInt const& exp) const {
+	if (!usable(base, exp)) return BigInt(-1, false);
+	if (exp.neg) {
+		BigInt inverse = invMod(base);
+		if (inverse.dataLength <= 0) return inverse;
+		return powMod(inverse, -exp);
+	}
+
+	limb *r = limbs::allocate(reducer->n);
+	limbs::powMod(*reducer, r, base.data, base.dataLength, exp.data, exp.dataLength);
+	BigInt x = result(r);
+	limbs::release(r);
+	return x;
+}
+
+// inverse
+BigInt BigInt::Modulus::invMod(BigInt const& a) const {
+	if (!usable(a, a)) return BigInt(-1, false);
+	return modInverse(a, value);
+}
+
+// into Montgomery form
+BigInt BigInt::Modulus::toMontgomery(BigInt const& a) const {
+	if (!usable(a, a)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(n + limbs::modScratch(n)), *tp = ra + n;
+	limbs::modToForm(*reducer, ra, a.data, a.dataLength, tp);
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+// out of Montgomery form
+BigInt BigInt::Modulus::fromMontgomery(BigInt const& a) const {
+	if (!usable(a, a)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(n + limbs::modScratch(n)), *tp = ra + n;
+	load(ra, a);
+	limbs::modFromForm(*reducer, ra, ra, tp);
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+// product in Montgomery form
+BigInt BigInt::Modulus::mulMontgomery(BigInt const& a, BigInt const& b) const {
+	if (!usable(a, b)) return BigInt(-1, false);
+	int n = reducer->n;
+	limb *ra = limbs::allocate(2 * n + limbs::modScratch(n)), *rb = ra + n, *tp = rb + n;
+	load(ra, a);
+	load(rb, b);
+	limbs::modMul(*reducer, ra, ra, rb, tp);
+	BigInt x = result(ra);
+	limbs::release(ra);
+	return x;
+}
+
+/*****************************************************************
+ * BigInt::Divisor
+ *****************************************************************/
+
+// precompute the constants for dividing by d
+BigInt::Divisor::Divisor(BigInt const& d) : value(d), inverse(NULL) {
+	if (d.dataLength > 0 && d != 0) {
+		inverse = new limbs::DivInverse;
+		limbs::divInit(*inverse, d.data, d.dataLength);
+	}
+}
+
+BigInt::Divisor::~Divisor() {
+	if (inverse != NULL) {
+		limbs::divFree(*inverse);
+		delete inverse;
+	}
+}
+
+// the divisor
+BigInt const& BigInt::Divisor::divisor() const {
+	return value;
+}
@@ -5,33 +5,116 @@
 #define BIGINT_H
 
 #include <iostream>
+#include <stdint.h>
+#include <string_view>
 
 // Set debug on or off. If on, it will assign a unique id to
 // every allocated array and print a debug message whenever an
 // array is allocated or deleted.
 #define DEBUG 0
 
+namespace limbs {
+class Allocator;
+struct ModReducer;
+struct DivInverse;
+}
+
+class RnsBigInt;
+
 /*****************************************************************
  * BigInt class
  *
- * Presently dummied up:
- * - does not implement integer values larger than the 'long' data
- *   type
- * - only operations related to '+' and '==' operator are defined
+ * The magnitude is stored in binary as an array of 64-bit limbs
+ * (least significant first) with a separate sign flag. The
+ * dataLength field doubles as a marker for the special values:
+ * - dataLength == -1: undefined (e.g. 0/0)
+ * - dataLength == 0: infinity (signed by 'neg')
+ *
+ * Magnitudes of up to INLINE_LIMBS limbs live in a buffer inside
+ * the object itself, so small values never touch the heap; larger
+ * ones spill to a heap array. 'data' points at whichever is in use.
+ * The compound operators work in place and grow the array with
+ * headroom, so a loop that keeps updating one BigInt stops
+ * allocating once the array is big enough; reserve() and
+ * shrink_to_fit() manage that room directly.
+ *
+ * Heap arrays come from the calling thread's current allocator:
+ * a per-thread cache over the global heap, unless a BigInt::Arena
+ * (or a custom Allocator installed with setAllocator()) is in
+ * effect.
+ *
+ * Very large products and squares can be shared among a pool of
+ * threads: setThreads() sizes the pool for the whole program, and
+ * a BigInt::Concurrency limits the threads one thread's operations
+ * may use.
  *
  *****************************************************************/
 
 class BigInt {
 private:
-	short *data; // our numeric data array
-	int dataLength; // length of data array
+	typedef uint64_t limb; // one binary digit of the magnitude
+
+	static const int INLINE_LIMBS = 2; // magnitudes stored in-object
+
+	limb *data; // our numeric data array (inlineData or heap)
+	int dataLength; // length of data array in limbs
+	int dataCapacity; // limbs data has room for (0 when null)
 	bool neg; // boolean flag for negative number
+	limb inlineData[INLINE_LIMBS]; // storage for small magnitudes
 #if DEBUG
 	unsigned long long id; // unique id for debug printing
 #endif
 
-	// constructor for building a BigInt from existing array
-	BigInt(int dataLengthIn, short *dataIn, bool negIn);
+	// converts to and from residues directly (see BigIntRns.h)
+	friend class RnsBigInt;
+
+	// constructor for a result of dataLengthIn limbs, which the
+	// caller fills in and then trims; lengths <= 0 give the special
+	// values
+	BigInt(int dataLengthIn, bool negIn);
+
+	// a positive number taking over the n-limb array p from
+	// limbs::allocate()
+	static BigInt adopt(limb *p, int n);
+
+	// point data at inline or heap storage for n limbs
+	void allocateData(int n);
+
+	// free the heap array, if any
+	void releaseData();
+
+	// strip leading zeros, keep zero positive and move small results
+	// back inline
+	void trim();
+
+	// strip leading zeros and keep zero positive, keeping the array
+	void trimLength();
+
+	// make room for at least n limbs (with headroom), keeping the
+	// current limbs
+	void growData(int n);
+
+	// move the current limbs into a heap array of exactly n limbs
+	void moveData(int n);
+
+	// this += (mNeg ? -m : m) in place (numbers only; m must not be
+	// this number's own array)
+	void addMagnitude(const limb *m, int mn, bool mNeg);
+
+	// this *= (mNeg ? -m : m) in place (numbers only)
+	void mulLimb(limb m, bool mNeg);
+
+	// this /= (dNeg ? -d : d) in place, for d != 0 (numbers only)
+	void divLimb(limb d, bool dNeg);
+
+	// this + (mNeg ? -m : m) for a single-limb m, in one pass
+	BigInt addLimb(limb m, bool mNeg) const;
+
+	// compare with a long, returning -1, 0 or 1 (numbers only)
+	int compareLong(long num) const;
+
+	// add or subtract one from the magnitude in place (numbers only)
+	void stepMagnitude(bool up);
 
 	// binary summation
 	BigInt sum(BigInt const& other) const;
@@ -45,26 +128,61 @@ private:
 	// helper method to compare absolute values (used for efficiency)
 	bool absGreaterThan(BigInt const& other) const;
 
-	// helper method to quickly multiply by 10
-	BigInt multBy10() const;
-
 	// helper method to divide with remainder
 	BigInt divide(BigInt const& other, BigInt &remainder) const;
 
 public:
+	// a source of memory for limb arrays (see BigIntLimbs.h)
+	typedef limbs::Allocator Allocator;
+
+	// scoped bump allocator for temporaries (defined below)
+	class Arena;
+
+	// running total of many values (defined below)
+	class Accumulator;
+
+	// arithmetic modulo a fixed modulus (defined below)
+	class Modulus;
+
+	// a divisor prepared for repeated division (defined below)
+	class Divisor;
+
+	// scoped limit on the threads operations may use (defined below)
+	class Concurrency;
+
+	// make alloc the source of new arrays on the calling thread (NULL
+	// restores the heap) and return the previous allocator. Arrays
+	// always go back to the allocator that made them
+	static Allocator *setAllocator(Allocator *alloc);
+
+	// let large multiplications use n threads in all, counting the
+	// caller (1, the default, keeps them on the calling thread), and
+	// return the previous count. Must not be called while any thread
+	// is computing
+	static int setThreads(int n);
+
 	// copy constructor
 	BigInt(BigInt const& orig);
 
+	// move constructor (leaves orig undefined)
+	BigInt(BigInt&& orig) noexcept;
+
 	// constructor where data value is passed as a long
 	BigInt(long num);
 
+	// constructor from text: an optional sign followed by decimal
+	// digits, or by hexadecimal digits after a "0x" prefix. Anything
+	// else gives an undefined value
+	explicit BigInt(std::string_view text);
+
 	// destructor
 	~BigInt();
 
-	BigInt operator=(BigInt const& src);
+	// assignment operator
+	BigInt& operator=(BigInt const& src);
 
-	//// assignment operator
-	//BigInt BigInt::operator=(BigInt const& other);
+	// move assignment operator (leaves src undefined)
+	BigInt& operator=(BigInt&& src) noexcept;
 
 	// binary '+' operator
 	BigInt operator+(BigInt const& other) const;
@@ -75,12 +193,90 @@ public:
 	// binary '*' operator
 	BigInt operator*(BigInt const& other) const;
 
+	// square of this number (cheaper than this * this with distinct
+	// operands; operator* switches to it when both sides are the same)
+	BigInt square() const;
+
+	// |base|^exp mod |mod|, the value repeated '*' and a final '%'
+	// would give, by sliding-window exponentiation with Montgomery
+	// reduction (odd moduli) or Barrett reduction (even ones). A
+	// negative exponent raises the inverse of the base instead. No
+	// inverse, a zero modulus or a special value gives undefined. Use
+	// a Modulus to reuse the reduction constants across calls
+	static BigInt powMod(BigInt const& base, BigInt const& exp, BigInt const& mod);
+
+	// greatest common divisor of |a| and |b|, by Lehmer's method or
+	// the half-gcd for long operands. gcd(a, 0) is |a|, and a special
+	// value gives undefined
+	static BigInt gcd(BigInt const& a, BigInt const& b);
+
+	// least common multiple of |a| and |b| (zero if either is zero)
+	static BigInt lcm(BigInt const& a, BigInt const& b);
+
+	// gcd(a, b), also setting x and y so that a x + b y = gcd(a, b)
+	// (all undefined if a or b is special)
+	static BigInt extendedGcd(BigInt const& a, BigInt const& b, BigInt &x, BigInt &y);
+
+	// the x in [0, |m|) with |a| x mod |m| = 1, as Modulus::invMod()
+	// gives; undefined if a and m have a common factor, m is zero or
+	// either is special
+	static BigInt modInverse(BigInt const& a, BigInt const& m);
+
+	// product of the numbers in [first, last) (1 if the range is
+	// empty), multiplied in pairs level by level like a balanced tree
+	// so the operands grow together and reach the fast tiers, rather
+	// than folded in one at a time
+	static BigInt product(BigInt const *first, BigInt const *last);
+
+	// product of the longs in [first, last), packed several to a limb
+	// before the tree
+	static BigInt product(long const *first, long const *last);
+
+	// sum of the numbers in [first, last) (0 if the range is empty),
+	// in a single carry-save pass through an Accumulator
+	static BigInt sum(BigInt const *first, BigInt const *last);
+
+	// n!, from the prime factorization by balanced product trees
+	// rather than a chain of n multiplications; undefined for n < 0
+	static BigInt factorial(long n);
+
+	// the binomial coefficient C(n, k), built the same way; zero for
+	// k < 0 or k > n, undefined for n < 0
+	static BigInt binomial(long n, long k);
+
+	// the primorial n#, the product of the primes up to n (1 for
+	// n < 2)
+	static BigInt primorial(long n);
+
+	// one term of a fused sum: a, or a * b when b is not NULL,
+	// subtracted instead of added when negate is set
+	struct Term {
+		BigInt const *a;
+		BigInt const *b;
+		bool negate;
+
+		// true if the term takes away from the total
+		bool subtracts() const;
+	};
+
+	// sum of n terms built in a single result array (the back end of
+	// the expression templates in BigIntExpr.h)
+	static BigInt fusedSum(Term const *terms, int n);
+
 	// binary '/' operator
 	BigInt operator/(BigInt const& other) const;
 
 	// binary '%' operator
 	BigInt operator%(BigInt const& other) const;
 
+	// binary '/' operator for a prepared divisor (same result as
+	// dividing by its value)
+	BigInt operator/(Divisor const& other) const;
+
+	// binary '%' operator for a prepared divisor (same result as
+	// taking the remainder by its value)
+	BigInt operator%(Divisor const& other) const;
+
 	// unary '+' operator
 	BigInt operator+() const;
 
@@ -88,56 +284,72 @@ public:
 	BigInt operator-() const;
 
 	// prefix '++' operator
-	BigInt operator++();
+	BigInt& operator++();
 
-	// postfix '++' operator
+	// postfix '++' operator (returns the old value)
 	BigInt operator++(int dummy);
 
 	// prefix '--' operator
-	BigInt operator--();
+	BigInt& operator--();
 
-	// postfix '--' operator
+	// postfix '--' operator (returns the old value)
 	BigInt operator--(int dummy);
 
 	// compound addition-assignment operator
-	BigInt operator+=(BigInt const& other);
+	BigInt& operator+=(BigInt const& other);
 
 	// compound subtraction-assignment operator
-	BigInt operator-=(BigInt const& other);
+	BigInt& operator-=(BigInt const& other);
 
 	// compound multiplication-assignment operator
-	BigInt operator*=(BigInt const& other);
+	BigInt& operator*=(BigInt const& other);
 
 	// compound division-assignment operator
-	BigInt operator/=(BigInt const& other);
+	BigInt& operator/=(BigInt const& other);
 
 	// compound mod-assignment operator
-	BigInt operator%=(BigInt const& other);
+	BigInt& operator%=(BigInt const& other);
+
+	// binary '+' operator for long
+	BigInt operator+(long num) const;
+
+	// binary '-' operator for long
+	BigInt operator-(long num) const;
+
+	// binary '*' operator for long
+	BigInt operator*(long num) const;
+
+	// binary '/' operator for long
+	BigInt operator/(long num) const;
+
+	// binary '%' operator for long
+	BigInt operator%(long num) const;
 
 	// compound addition-assignment operator for long
-	inline BigInt operator+=(long const& num) {
-		return *this = *this + BigInt(num);
-	}
+	BigInt& operator+=(long num);
 
 	// compound subtraction-assignment operator for long
-	inline BigInt operator-=(long const& num) {
-		return *this = *this - BigInt(num);
-	}
+	BigInt& operator-=(long num);
 
 	// compound multiplication-assignment operator for long
-	inline BigInt operator*=(long const& num) {
-		return *this = *this * BigInt(num);
-	}
+	BigInt& operator*=(long num);
 
 	// compound division-assignment operator for long
-	inline BigInt operator/=(long const& num) {
-		return *this = *this / BigInt(num);
-	}
+	BigInt& operator/=(long num);
 
 	// compound mod-assignment operator for long
-	inline BigInt operator%=(long const& num) {
-		return *this = *this % BigInt(num);
-	}
+	BigInt& operator%=(long num);
+
+	// bits of magnitude this number can hold without reallocating
+	long capacity() const;
+
+	// make room for a magnitude of at least the given number of bits,
+	// keeping the value
+	void reserve(long bits);
+
+	// give back room the value does not need (small values move back
+	// inline)
+	void shrink_to_fit();
 
 	// equality operation
 	bool operator==(BigInt const& other) const;
@@ -157,18 +369,275 @@ public:
 	// equality operation
 	bool operator<=(BigInt const& other) const;
 
+	// equality operation for long
+	bool operator==(long num) const;
+
+	// inequality operation for long
+	bool operator!=(long num) const;
+
+	// greater-than operation for long
+	bool operator>(long num) const;
+
+	// greater-than-or-equal operation for long
+	bool operator>=(long num) const;
+
+	// less-than operation for long
+	bool operator<(long num) const;
+
+	// less-than-or-equal operation for long
+	bool operator<=(long num) const;
+
 	// output-stream operator for BigInt (non-member function)
 	friend std::ostream & operator<<(std::ostream& os, const BigInt& num);
+
+	// input-stream operator for BigInt (non-member function); sets
+	// failbit if the next token is not a number
+	friend std::istream & operator>>(std::istream& is, BigInt& num);
+};
+
+/*****************************************************************
+ * BigInt::Arena
+ *
+ * While an Arena is alive, every array allocated on its thread is
+ * carved out of large blocks by bumping a pointer, and freeing the
+ * most recent array just rolls the pointer back. The whole arena is
+ * returned to the heap at once when it goes out of scope, which
+ * makes it a cheap home for the temporaries of a long computation.
+ *
+ * Arenas are per-thread and nest: each one restores the allocator
+ * that was current when it was created, so they must be destroyed
+ * in reverse order of creation. No value holding arena memory may
+ * outlive its arena; use keep() to copy a result out first.
+ *
+ *****************************************************************/
+
+class BigInt::Arena {
+private:
+	struct Impl; // the allocator itself (see BigInt.cpp)
+	Impl *impl;
+
+	Arena(Arena const&) = delete;
+	Arena& operator=(Arena const&) = delete;
+
+public:
+	// install a new arena as this thread's allocator
+	Arena();
+
+	// restore the previous allocator and free everything at once
+	~Arena();
+
+	// copy of value allocated from the previous allocator, so it can
+	// outlive this arena
+	BigInt keep(BigInt const& value) const;
+};
+
+/*****************************************************************
+ * BigInt::Concurrency
+ *
+ * While a Concurrency is alive, the operations started on its
+ * thread use at most the given number of threads: 1 keeps them on
+ * the calling thread, and larger values let them spread over the
+ * pool, up to its size set by setThreads(). Like Arenas they are
+ * per-thread, nest, and restore the previous limit when they go out
+ * of scope.
+ *
+ *****************************************************************/
+
+class BigInt::Concurrency {
+private:
+	int previous; // the limit this one replaced
+
+	Concurrency(Concurrency const&) = delete;
+	Concurrency& operator=(Concurrency const&) = delete;
+
+public:
+	// limit this thread's operations to threads threads
+	explicit Concurrency(int threads);
+
+	// restore the previous limit
+	~Concurrency();
+};
+
+/*****************************************************************
+ * BigInt::Accumulator
+ *
+ * Adds up any number of BigInts far faster than repeated +=. Each
+ * value is added limb by limb into a wide buffer without carrying
+ * from one limb to the next; the carries are only counted, and are
+ * resolved in a single pass when result() is called. Subtracted
+ * values go into a second buffer that is taken off at the end, and
+ * special values are tracked on their own, following the usual
+ * rules.
+ *
+ *****************************************************************/
+
+class BigInt::Accumulator {
+private:
+	// one carry-save total: the value is the sum over i of
+	// (sum[i] + carry[i]) * 2^(64 i)
+	struct Part {
+		limb *sum;
+		limb *carry; // length + 1 carry counts
+		int length; // limbs in use
+		int capacity; // limbs allocated
+		long adds; // values added since the counts were last resolved
+	};
+
+	Part positive, negative;
+	BigInt special; // sum of any infinite or undefined values
+	bool hasSpecial;
+
+	Accumulator(Accumulator const&) = delete;
+	Accumulator& operator=(Accumulator const&) = delete;
+
+	// make room in a part for n limbs, keeping its contents
+	static void grow(Part &part, int n);
+
+	// add a magnitude of n limbs into one part
+	static void addTo(Part &part, const limb *a, int n);
+
+	// fold a part's carry counts into its limbs
+	static void resolve(Part &part);
+
+public:
+	// an empty total (zero)
+	Accumulator();
+
+	~Accumulator();
+
+	// add a value to the total
+	Accumulator& operator+=(BigInt const& value);
+
+	// subtract a value from the total
+	Accumulator& operator-=(BigInt const& value);
+
+	// the total so far (adding may continue afterwards)
+	BigInt result();
+
+	// reset the total to zero, keeping the buffers
+	void clear();
+};
+
+/*****************************************************************
+ * BigInt::Modulus
+ *
+ * Arithmetic modulo a fixed m. The reduction constants (Montgomery
+ * for odd m, Barrett for even m) are worked out once when the
+ * Modulus is made, so each operation costs a few multiplications
+ * and no division, where a % m divides afresh every time.
+ *
+ * Operands are taken as |a| mod m, the value a % m gives, and
+ * results always lie in [0, m). Special values, and any operation
+ * on a zero or special modulus, give undefined. The member
+ * functions are const and keep their scratch space to themselves,
+ * so one Modulus may be shared between threads.
+ *
+ * Longer computations can stay in Montgomery form: toMontgomery()
+ * converts an operand once, mulMontgomery() multiplies in that form
+ * with a single reduction (addMod() and subMod() work in it too),
+ * and fromMontgomery() converts the result back. For even m the
+ * form is just the ordinary residue.
+ *
+ *****************************************************************/
+
+class BigInt::Modulus {
+private:
+	BigInt value; // |m|
+	limbs::ModReducer *reducer; // NULL when m is zero or special
+
+	Modulus(Modulus const&) = delete;
+	Modulus& operator=(Modulus const&) = delete;
+
+	// |a| mod m into r, which has room for as many limbs as m
+	// (a must be a number)
+	void load(limb *r, BigInt const& a) const;
+
+	// a residue of as many limbs as m, as a BigInt
+	BigInt result(const limb *r) const;
+
+	// false if m is unusable or either operand is special
+	bool usable(BigInt const& a, BigInt const& b) const;
+
+public:
+	// precompute the constants for arithmetic modulo |m|
+	explicit Modulus(BigInt const& m);
+
+	~Modulus();
+
+	// the modulus |m|
+	BigInt const& modulus() const;
+
+	// |a| mod m
+	BigInt reduce(BigInt const& a) const;
+
+	// (a + b) mod m
+	BigInt addMod(BigInt const& a, BigInt const& b) const;
+
+	// (a - b) mod m
+	BigInt subMod(BigInt const& a, BigInt const& b) const;
+
+	// (a * b) mod m
+	BigInt mulMod(BigInt const& a, BigInt const& b) const;
+
+	// a^2 mod m
+	BigInt sqrMod(BigInt const& a) const;
+
+	// base^exp mod m; a negative exponent raises the inverse of the
+	// base
+	BigInt powMod(BigInt const& base, BigInt const& exp) const;
+
+	// the x in [0, m) with a * x mod m = 1, or undefined if a and m
+	// have a common factor
+	BigInt invMod(BigInt const& a) const;
+
+	// a * R mod m, the Montgomery form of a (R = 2^64 to the number
+	// of limbs in m)
+	BigInt toMontgomery(BigInt const& a) const;
+
+	// a / R mod m, the value whose Montgomery form is a
+	BigInt fromMontgomery(BigInt const& a) const;
+
+	// a * b / R mod m: the product of two values in Montgomery form,
+	// in Montgomery form
+	BigInt mulMontgomery(BigInt const& a, BigInt const& b) const;
+};
+
+/*****************************************************************
+ * BigInt::Divisor
+ *
+ * A divisor prepared once for dividing many numbers by it. The
+ * divisor is kept normalized together with its reciprocal, so
+ * x / d and x % d skip the per-call setup; single-limb divisors
+ * then divide without any hardware division, and long ones turn
+ * each block of the quotient into multiplications. Results are
+ * exactly those of dividing by the plain value, including the
+ * special cases.
+ *
+ *****************************************************************/
+
+class BigInt::Divisor {
+private:
+	BigInt value; // the divisor
+	limbs::DivInverse *inverse; // NULL when the divisor is zero or special
+
+	Divisor(Divisor const&) = delete;
+	Divisor& operator=(Divisor const&) = delete;
+
+	friend class BigInt;
+
+public:
+	// precompute the constants for dividing by d
+	explicit Divisor(BigInt const& d);
+
+	~Divisor();
+
+	// the divisor d
+	BigInt const& divisor() const;
 };
 
 // addition operator where left operand is a long
 inline BigInt operator+(long num, BigInt const& val) {
-	return BigInt(num) + val;
-}
-
-// addition operator where right operand is a long
-inline BigInt operator+(BigInt const& val, long num) {
-	return val + BigInt(num);
+	return val + num;
 }
 
 // subtraction operator where left operand is a long
@@ -176,19 +645,9 @@ inline BigInt operator-(long num, BigInt const& val) {
 	return BigInt(num) - val;
 }
 
-// subtraction operator where right operand is a long
-inline BigInt operator-(BigInt const& val, long num) {
-	return val - BigInt(num);
-}
-
 // multiplication operator where left operand is a long
 inline BigInt operator*(long num, BigInt const& val) {
-	return BigInt(num) * val;
-}
-
-// multiplication operator where right operand is a long
-inline BigInt operator*(BigInt const& val, long num) {
-	return val * BigInt(num);
+	return val * num;
 }
 
 // division operator where left operand is a long
@@ -196,79 +655,39 @@ inline BigInt operator/(long num, BigInt const& val) {
 	return BigInt(num) / val;
 }
 
-// division operator where right operand is a long
-inline BigInt operator/(BigInt const& val, long num) {
-	return val / BigInt(num);
-}
-
 // mod operator where left operand is a long
 inline BigInt operator%(long num, BigInt const& val) {
 	return BigInt(num) % val;
 }
 
-// mod operator where right operand is a long
-inline BigInt operator%(BigInt const& val, long num) {
-	return val % BigInt(num);
-}
-
 // equality operator where left operand is a long
 inline bool operator==(long num, BigInt const& val) {
-	return BigInt(num) == val;
-}
-
-// equality operator where right operand is a long
-inline bool operator==(BigInt const& val, long num) {
-	return val == BigInt(num);
+	return val == num;
 }
 
 // inequality operator where left operand is a long
 inline bool operator!=(long num, BigInt const& val) {
-	return BigInt(num) != val;
-}
-
-// inequality operator where right operand is a long
-inline bool operator!=(BigInt const& val, long num) {
-	return val != BigInt(num);
+	return val != num;
 }
 
 // greater-than operator where left operand is a long
 inline bool operator>(long num, BigInt const& val) {
-	return BigInt(num) > val;
-}
-
-// greater-than operator where right operand is a long
-inline bool operator>(BigInt const& val, long num) {
-	return val > BigInt(num);
+	return val < num;
 }
 
 // greater-than-or-equal operator where left operand is a long
 inline bool operator>=(long num, BigInt const& val) {
-	return BigInt(num) >= val;
-}
-
-// greater-than-or-equal operator where right operand is a long
-inline bool operator>=(BigInt const& val, long num) {
-	return val >= BigInt(num);
+	return val <= num;
 }
 
 // less-than operator where left operand is a long
 inline bool operator<(long num, BigInt const& val) {
-	return BigInt(num) < val;
-}
-
-// less-than operator where right operand is a long
-inline bool operator<(BigInt const& val, long num) {
-	return val < BigInt(num);
+	return val > num;
 }
 
 // less-than-or-equal operator where left operand is a long
 inline bool operator<=(long num, BigInt const& val) {
-	return BigInt(num) <= val;
-}
-
-// less-than-or-equal operator where right operand is a long
-inline bool operator<=(BigInt const& val, long num) {
-	return val <= BigInt(num);
+	return val >= num;
 }
 
 #endif
@@ -0,0 +1,232 @@
+/****************************************************************
+ * BigIntAlloc.cpp -- memory management for limb arrays
+ ****************************************************************/
+#include <stddef.h>
+#include <atomic>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * limb array allocation
+ *
+ * Every array is preceded by a two-limb header naming the
+ * allocator that made it and its length, so release() can always
+ * hand it back to its source, whichever thread frees it.
+ *
+ * Unless a custom allocator is installed, arrays come from a cache
+ * owned by the allocating thread: blocks are rounded up to a power
+ * of two and recycled through per-size free lists that only the
+ * owner touches, so the common allocate/release pair takes no lock
+ * and no atomic operation. A block freed by another thread is
+ * pushed onto the owner's lock-free inbox and collected the next
+ * time the owner runs short. When a thread exits its cache is
+ * emptied and orphaned; blocks still out in other threads go
+ * straight to the heap when they come back, and the last one frees
+ * the cache itself. Arrays too big for the largest size class
+ * bypass the cache.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// two header limbs keep arrays 16-byte aligned
+const int HEADER_LIMBS = 2;
+
+// cached block sizes run from 2^MIN_CLASS_BITS to 2^MAX_CLASS_BITS
+// limbs (32 bytes to 256 KiB)
+const int MIN_CLASS_BITS = 2;
+const int MAX_CLASS_BITS = 15;
+const int CLASSES = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+
+// limbs each free list may hold on to (at least two blocks)
+const int CACHE_LIMBS = 1 << 16;
+
+// index of the smallest size class holding n limbs
+static inline int sizeClass(int n) {
+	int bits = 32 - __builtin_clz((unsigned)(n - 1));
+	return (bits < MIN_CLASS_BITS) ? 0 : bits - MIN_CLASS_BITS;
+}
+
+// marks the inbox of a cache whose thread has exited
+static limb orphanMark[1];
+static limb *const ORPHANED = orphanMark;
+
+// one thread's free lists; blocks are linked through their first limb
+class ThreadCache : public Allocator {
+private:
+	limb *freeList[CLASSES];
+	int freeCount[CLASSES];
+	long outstanding; // blocks handed out and not yet back (owner only)
+	std::atomic<limb *> inbox; // blocks returned by other threads
+	std::atomic<long> orphanDebt; // blocks still out after the owner exits
+
+	// file a free block under its class, or give it to the heap if
+	// the list is full
+	void keep(limb *block, int c) {
+		int cap = CACHE_LIMBS >> (c + MIN_CLASS_BITS);
+		if (freeCount[c] < cap || freeCount[c] < 2) {
+			block[0] = (limb)(uintptr_t)freeList[c];
+			freeList[c] = block;
+			freeCount[c]++;
+		}
+		else {
+			delete[] block;
+		}
+	}
+
+	// move everything other threads have returned onto the free lists
+	void collect() {
+		limb *block = inbox.exchange(NULL, std::memory_order_acquire);
+		while (block != NULL) {
+			limb *next = (limb *)(uintptr_t)block[0];
+			outstanding--;
+			keep(block, sizeClass((int)block[1]));
+			block = next;
+		}
+	}
+
+public:
+	ThreadCache() : outstanding(0), inbox(NULL), orphanDebt(0) {
+		for (int c = 0; c < CLASSES; c++) {
+			freeList[c] = NULL;
+			freeCount[c] = 0;
+		}
+	}
+
+	limb *allocate(int n);
+	void release(limb *p, int n);
+
+	// empty the cache when its thread exits, and free it once no
+	// block is still out
+	void retire();
+};
+
+// the calling thread's cache, created on first use; NULL once the
+// thread has started to exit
+static thread_local ThreadCache *localCache = NULL;
+static thread_local bool cacheRetired = false;
+
+// retires the thread's cache when the thread exits
+struct CacheRetirer {
+	~CacheRetirer() {
+		ThreadCache *cache = localCache;
+		localCache = NULL;
+		cacheRetired = true;
+		if (cache != NULL) cache->retire();
+	}
+};
+
+static ThreadCache *threadCache() {
+	if (localCache == NULL && !cacheRetired) {
+		static thread_local CacheRetirer retirer;
+		(void)retirer;
+		localCache = new ThreadCache;
+	}
+	return localCache;
+}
+
+// take a block of at least n limbs from the owner's free lists
+limb *ThreadCache::allocate(int n) {
+	int c = sizeClass(n);
+	if (freeList[c] == NULL && inbox.load(std::memory_order_relaxed) != NULL) {
+		collect();
+	}
+	limb *block = freeList[c];
+	if (block != NULL) {
+		freeList[c] = (limb *)(uintptr_t)block[0];
+		freeCount[c]--;
+	}
+	else {
+		block = new limb[(size_t)1 << (c + MIN_CLASS_BITS)];
+	}
+	outstanding++;
+	return block;
+}
+
+// recycle a block: straight onto a free list from the owning thread,
+// through the inbox from any other
+void ThreadCache::release(limb *block, int n) {
+	if (this == localCache) {
+		outstanding--;
+		keep(block, sizeClass(n));
+		return;
+	}
+
+	block[1] = (limb)n;
+	limb *head = inbox.load(std::memory_order_relaxed);
+	do {
+		if (head == ORPHANED) {
+			delete[] block;
+			if (orphanDebt.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+			return;
+		}
+		block[0] = (limb)(uintptr_t)head;
+	} while (!inbox.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// empty the cache and hand the count of blocks still out to
+// orphanDebt; whoever brings it to zero frees the cache
+void ThreadCache::retire() {
+	limb *block = inbox.exchange(ORPHANED, std::memory_order_acquire);
+	while (block != NULL) {
+		limb *next = (limb *)(uintptr_t)block[0];
+		delete[] block;
+		outstanding--;
+		block = next;
+	}
+	for (int c = 0; c < CLASSES; c++) {
+		while (freeList[c] != NULL) {
+			block = freeList[c];
+			freeList[c] = (limb *)(uintptr_t)block[0];
+			delete[] block;
+		}
+		freeCount[c] = 0;
+	}
+	long debt = outstanding;
+	if (orphanDebt.fetch_add(debt, std::memory_order_acq_rel) + debt == 0) delete this;
+}
+
+static thread_local Allocator *currentAllocator = NULL;
+
+// install a new allocator for this thread
+Allocator *setAllocator(Allocator *alloc) {
+	Allocator *previous = currentAllocator;
+	currentAllocator = alloc;
+	return previous;
+}
+
+// allocate n limbs from the given allocator (NULL for the heap) and
+// write the header
+static limb *allocateFrom(Allocator *owner, int n) {
+	limb *block = (owner != NULL) ? owner->allocate(n + HEADER_LIMBS) : new limb[n + HEADER_LIMBS];
+	block[0] = (limb)(uintptr_t)owner;
+	block[1] = (limb)n;
+	return block + HEADER_LIMBS;
+}
+
+// allocate an array of n limbs
+limb *allocate(int n) {
+	Allocator *owner = currentAllocator;
+	if (owner == NULL && n + HEADER_LIMBS <= (1 << MAX_CLASS_BITS)) {
+		owner = threadCache();
+	}
+	return allocateFrom(owner, n);
+}
+
+// allocate an array of n limbs from the heap
+limb *allocateHeap(int n) {
+	return allocateFrom(NULL, n);
+}
+
+// return an array to the allocator named in its header
+void release(limb *p) {
+	limb *block = p - HEADER_LIMBS;
+	Allocator *owner = (Allocator *)(uintptr_t)block[0];
+	if (owner != NULL) {
+		owner->release(block, (int)block[1] + HEADER_LIMBS);
+	}
+	else {
+		delete[] block;
+	}
+}
+
+}
@@ -0,0 +1,358 @@
+/****************************************************************
+ * BigIntComb.cpp -- products, factorials, binomials and primorials
+ ****************************************************************/
+#include <stddef.h>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * products of many factors
+ *
+ * A left fold over a list of factors multiplies a growing product
+ * by one small factor at a time, which keeps every step on the
+ * schoolbook tier and costs quadratic time overall. A product tree
+ * multiplies neighbours in pairs instead, then pairs of those
+ * products, and so on, so both operands grow together and the
+ * upper levels run on the fast tiers. productMany() works level by
+ * level between two buffers, each big enough for the sum of the
+ * factor lengths (a product never needs more limbs than its
+ * operands together), so the whole tree allocates only those two.
+ * One-limb factors are first packed several to a limb. The products
+ * of a level are independent, and run as parallel tasks when they
+ * are large and the calling thread may use more than one thread.
+ *
+ * combinatorial functions
+ *
+ * n!, C(n, k) and the primorial n# are all products of prime powers
+ * p^e(p) with p <= n, and the exponents are cheap to find:
+ * Legendre's formula sums floor(n / p^i) for n!, and C(n, k) takes
+ * the sums for k and n - k off that. So rather than multiply 2, 3,
+ * ..., n in a chain, where every step is a long-by-one-limb product
+ * and the whole costs quadratic time, the prime powers are grouped
+ * by the bits of their exponents:
+ *
+ *   prod p^e(p) = prod_j (product of the p with bit j of e(p) set)^(2^j)
+ *
+ * and evaluated from the top bit down as r = r^2 * P_j. Each P_j is
+ * a balanced product tree over primes packed several to a limb, so
+ * the work lands on squarings and multiplications of near-equal
+ * operands, which the Karatsuba, Toom and NTT tiers handle in
+ * quasi-linear time. The power of two is applied last as a shift.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// factor counts at or below which a product tree multiplies its
+// leaves in a chain rather than splitting further
+const int PRODUCT_BASECASE = 16;
+
+// operand length (in limbs, or factors for one-limb factors) from
+// which the products of one level run in parallel
+const int PARALLEL_PRODUCT_THRESHOLD = 2000;
+
+// number of bits in a nonzero limb
+static inline int bitLength(limb a) {
+	return LIMB_BITS - __builtin_clzll(a);
+}
+
+// the odd primes up to n into a new array from allocate(), storing
+// how many there are in count (sieve of Eratosthenes on odd numbers)
+static limb *oddPrimes(unsigned long n, int &count) {
+	count = 0;
+	if (n < 3) return allocate(1);
+
+	// bit i of composite stands for 2 i + 1
+	unsigned long last = (n - 1) / 2;
+	int words = (int)(last / LIMB_BITS + 1);
+	limb *composite = allocate(words);
+	zero(composite, words);
+	for (unsigned long i = 1; (2 * i + 1) * (2 * i + 1) <= n; i++) {
+		if ((composite[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1) continue;
+		unsigned long p = 2 * i + 1;
+		for (unsigned long j = p * p / 2; j <= last; j += p) {
+			composite[j / LIMB_BITS] |= (limb)1 << (j % LIMB_BITS);
+		}
+	}
+
+	for (unsigned long i = 1; i <= last; i++) {
+		if (((composite[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1) == 0) count++;
+	}
+	limb *primes = allocate(count + 1);
+	int k = 0;
+	for (unsigned long i = 1; i <= last; i++) {
+		if (((composite[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1) == 0) primes[k++] = 2 * i + 1;
+	}
+	release(composite);
+	return primes;
+}
+
+// exponent of the prime p in n! by Legendre's formula
+static limb legendre(unsigned long n, limb p) {
+	limb e = 0;
+	while (n >= p) {
+		n /= p;
+		e += n;
+	}
+	return e;
+}
+
+// multiply runs of neighbouring factors together for as long as the
+// product fits in a limb, returning the new count (count >= 1)
+static int pack(limb *f, int count) {
+	int m = 0;
+	limb acc = f[0];
+	for (int i = 1; i < count; i++) {
+		dlimb t = (dlimb)acc * f[i];
+		if ((limb)(t >> LIMB_BITS) != 0) {
+			f[m++] = acc;
+			acc = f[i];
+		}
+		else {
+			acc = (limb)t;
+		}
+	}
+	f[m++] = acc;
+	return m;
+}
+
+// r = a * b, or the product of count one-limb factors f when a is
+// NULL, waiting in a batch
+struct ProductJob {
+	limb *r;
+	const limb *a;
+	int an;
+	const limb *b;
+	int bn;
+	const limb *f;
+	int count;
+	int rn; // the normalized length of a tree product
+};
+
+static int productTree(limb *r, const limb *f, int count);
+
+static void runProduct(void *arg) {
+	ProductJob *job = (ProductJob *)arg;
+	if (job->a == NULL) {
+		job->rn = productTree(job->r, job->f, job->count);
+	}
+	else {
+		mul(job->r, job->a, job->an, job->b, job->bn);
+	}
+}
+
+// r = the product of the count nonzero one-limb factors f, split in
+// halves of equal length (built in parallel when long enough);
+// writes at most count limbs and returns the normalized length
+static int productTree(limb *r, const limb *f, int count) {
+	if (count <= PRODUCT_BASECASE) {
+		r[0] = f[0];
+		int rn = 1;
+		for (int i = 1; i < count; i++) {
+			limb high = mul1(r, r, rn, f[i]);
+			if (high != 0) r[rn++] = high;
+		}
+		return rn;
+	}
+
+	int h = count / 2;
+	limb *t = allocate(count);
+	ProductJob halves[2] = {
+		{t, NULL, 0, NULL, 0, f, h, 0},
+		{t + h, NULL, 0, NULL, 0, f + h, count - h, 0}
+	};
+	if (count >= PARALLEL_PRODUCT_THRESHOLD && concurrency() > 1) {
+		Task tasks[2] = {{runProduct, &halves[0]}, {runProduct, &halves[1]}};
+		runTasks(tasks, 2);
+	}
+	else {
+		runProduct(&halves[0]);
+		runProduct(&halves[1]);
+	}
+	mul(r, t, halves[0].rn, t + h, halves[1].rn);
+	release(t);
+	return normalize(r, halves[0].rn + halves[1].rn);
+}
+
+// product of one-limb factors
+int product1(limb *r, limb *f, int count) {
+	return productTree(r, f, pack(f, count));
+}
+
+// product of count magnitudes
+int productMany(limb *r, const limb *const *a, const int *an, int count) {
+	if (count == 1) {
+		copy(r, a[0], an[0]);
+		return an[0];
+	}
+
+	// the levels alternate between r and a scratch buffer, starting
+	// with whichever makes the last one land in r. Each product goes
+	// where the first of its operands sat, which leaves room for it
+	// whatever the others' lengths turn out to be
+	int levels = 0;
+	for (int m = count; m > 1; m = (m + 1) / 2) {
+		levels++;
+	}
+	int total = 0;
+	int *off = new int[count];
+	int *len = new int[count];
+	for (int i = 0; i < count; i++) {
+		off[i] = total;
+		len[i] = an[i];
+		total += an[i];
+	}
+	limb *scratch = allocate(total);
+	limb *out = (levels % 2 == 1) ? scratch : r;
+	ProductJob *jobs = new ProductJob[(count + 1) / 2];
+	Task *tasks = new Task[(count + 1) / 2];
+	bool parallel = concurrency() > 1;
+
+	// the first level reads the factors where they are
+	const limb *const *in = a;
+	int m = count;
+	while (m > 1) {
+		limb *next = (out == r) ? scratch : r;
+		int pairs = m / 2;
+		int largest = 0;
+		for (int k = 0; k < pairs; k++) {
+			const limb *x = (in == a) ? a[2 * k] : out + off[2 * k];
+			const limb *y = (in == a) ? a[2 * k + 1] : out + off[2 * k + 1];
+			ProductJob job = {next + off[2 * k], x, len[2 * k], y, len[2 * k + 1], NULL, 0, 0};
+			jobs[k] = job;
+			tasks[k].run = runProduct;
+			tasks[k].arg = &jobs[k];
+			int shorter = (len[2 * k] < len[2 * k + 1]) ? len[2 * k] : len[2 * k + 1];
+			if (shorter > largest) largest = shorter;
+		}
+		if (parallel && largest >= PARALLEL_PRODUCT_THRESHOLD) {
+			runTasks(tasks, pairs);
+		}
+		else {
+			for (int k = 0; k < pairs; k++) {
+				runProduct(&jobs[k]);
+			}
+		}
+
+		for (int k = 0; k < pairs; k++) {
+			off[k] = off[2 * k];
+			len[k] = normalize(next + off[k], len[2 * k] + len[2 * k + 1]);
+		}
+		if (m % 2 == 1) {
+			// the odd one out moves up unchanged
+			const limb *x = (in == a) ? a[m - 1] : out + off[m - 1];
+			off[pairs] = off[m - 1];
+			len[pairs] = len[m - 1];
+			copy(next + off[pairs], x, len[pairs]);
+		}
+		in = NULL;
+		out = next;
+		m = (m + 1) / 2;
+	}
+
+	int rn = len[0];
+	delete[] jobs;
+	delete[] tasks;
+	delete[] off;
+	delete[] len;
+	release(scratch);
+	return rn;
+}
+
+// 2^twos times the product of p[i]^e[i] over count odd primes, into a
+// new array from allocate() with its normalized length in rn
+static limb *powerProduct(const limb *p, const limb *e, int count, limb twos, int &rn) {
+	// the value has fewer than bits bits; top gathers the exponent bits
+	limb bits = twos + 1, top = 0;
+	for (int i = 0; i < count; i++) {
+		bits += e[i] * bitLength(p[i]);
+		top |= e[i];
+	}
+	int n = (int)(bits / LIMB_BITS + 2);
+	limb *r = allocate(n);
+	limb *t = allocate(n);
+	limb *f = allocate(count + 1);
+
+	r[0] = 1;
+	rn = 1;
+	for (int j = (top == 0) ? -1 : bitLength(top) - 1; j >= 0; j--) {
+		if (rn > 1 || r[0] > 1) {
+			sqr(t, r, rn);
+			rn = normalize(t, 2 * rn);
+			limb *swap = r; r = t; t = swap;
+		}
+
+		int fn = 0;
+		for (int i = 0; i < count; i++) {
+			if ((e[i] >> j) & 1) f[fn++] = p[i];
+		}
+		if (fn == 0) continue;
+		limb *q = allocate(fn);
+		int qn = product1(q, f, fn);
+		mul(t, r, rn, q, qn);
+		rn = normalize(t, rn + qn);
+		limb *swap = r; r = t; t = swap;
+		release(q);
+	}
+
+	// the factor of 2^twos
+	int limbShift = (int)(twos / LIMB_BITS);
+	int bitShift = (int)(twos % LIMB_BITS);
+	zero(t, limbShift);
+	if (bitShift == 0) {
+		copy(t + limbShift, r, rn);
+		rn += limbShift;
+	}
+	else {
+		t[rn + limbShift] = shl(t + limbShift, r, rn, bitShift);
+		rn = normalize(t, rn + limbShift + 1);
+	}
+
+	release(f);
+	release(r);
+	return t;
+}
+
+// n!
+limb *factorial(unsigned long n, int &rn) {
+	int count;
+	limb *p = oddPrimes(n, count);
+	limb *e = allocate(count + 1);
+	for (int i = 0; i < count; i++) {
+		e[i] = legendre(n, p[i]);
+	}
+	limb *r = powerProduct(p, e, count, legendre(n, 2), rn);
+	release(e);
+	release(p);
+	return r;
+}
+
+// C(n, k) for k <= n
+limb *binomial(unsigned long n, unsigned long k, int &rn) {
+	int count;
+	limb *p = oddPrimes(n, count);
+	limb *e = allocate(count + 1);
+	for (int i = 0; i < count; i++) {
+		e[i] = legendre(n, p[i]) - legendre(k, p[i]) - legendre(n - k, p[i]);
+	}
+	limb twos = legendre(n, 2) - legendre(k, 2) - legendre(n - k, 2);
+	limb *r = powerProduct(p, e, count, twos, rn);
+	release(e);
+	release(p);
+	return r;
+}
+
+// the product of the primes up to n
+limb *primorial(unsigned long n, int &rn) {
+	int count;
+	limb *p = oddPrimes(n, count);
+	limb *e = allocate(count + 1);
+	for (int i = 0; i < count; i++) {
+		e[i] = 1;
+	}
+	limb *r = powerProduct(p, e, count, (n >= 2) ? 1 : 0, rn);
+	release(e);
+	release(p);
+	return r;
+}
+
+}
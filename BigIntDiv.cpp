@@ -0,0 +1,274 @@
+/****************************************************************
+ * BigIntDiv.cpp -- size-dispatched division for BigInt
+ ****************************************************************/
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * division engine
+ *
+ * limbs::divmod() normalizes the divisor so its top bit is set and
+ * then picks an algorithm by operand size:
+ * - below DC_DIV_THRESHOLD: schoolbook (divBasecase, Knuth D)
+ * - otherwise: Burnikel-Ziegler divide-and-conquer division
+ *
+ * Burnikel-Ziegler divides 2n limbs by n limbs as two recursive
+ * divisions of 3n/2 limbs by n limbs, each of which divides by the
+ * top half of the divisor and then corrects the partial remainder
+ * with one multiplication by the bottom half. The bulk of the work
+ * is therefore done by limbs::mul, and division costs a small
+ * multiple of a multiplication of the same size.
+ *
+ * When many numbers are divided by the same divisor, divInit()
+ * does the divisor's share of the work once: it keeps the divisor
+ * normalized along with the reciprocal of its top limb, and for
+ * long divisors the reciprocal floor(B^(2n) / d) of the whole
+ * divisor. divmodPre() then only has to shift the dividend, and
+ * long divisors turn every n-limb block of quotient into two
+ * multiplications and a small correction (Barrett's method) in
+ * place of a recursive division.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// divisor and quotient length (in limbs) at which recursion pays off
+// (must be at least 4 so the halves stay valid for divBasecase)
+const int DC_DIV_THRESHOLD = 60;
+
+static const limb ONE = 1;
+
+// a -= q * b_low, where the quotient q (qn limbs, top limb qh) was
+// found by dividing by the top of b and b_low is the bn - qn limbs
+// below it. Decrements q until the remainder a[0..bn) is
+// non-negative, and returns the corrected top quotient limb. tp is
+// scratch of bn limbs
+static limb divFixup(limb *q, int qn, limb qh, limb *a, const limb *b, int bn, limb *tp) {
+	mul(tp, q, qn, b, bn - qn);
+	limb cy = subFrom(a, bn, tp, bn);
+	if (qh != 0) cy += subFrom(a + qn, bn - qn, b, bn - qn);
+
+	// each correction adds b back; there are at most two
+	while (cy != 0) {
+		qh -= subFrom(q, qn, &ONE, 1);
+		cy -= add(a, a, bn, b, bn);
+	}
+	return qh;
+}
+
+// q = a / b where a has 2n limbs and b has n limbs with its top bit
+// set. Writes n limbs of q, returns the top quotient limb and leaves
+// the remainder in the low n limbs of a. tp is scratch of n limbs
+static limb divDC2by1(limb *q, limb *a, const limb *b, int n, limb *tp) {
+	if (n < DC_DIV_THRESHOLD) {
+		return divBasecase(q, a, 2 * n, b, n);
+	}
+
+	int lo = n / 2, hi = n - lo;
+
+	// high quotient half: the top 3 * hi limbs of a by b, using the
+	// top hi limbs of b and then correcting with the low lo limbs
+	limb qh = divDC2by1(q + lo, a + 2 * lo, b + lo, hi, tp);
+	qh = divFixup(q + lo, hi, qh, a + lo, b, n, tp);
+
+	// low quotient half: the remaining 3 * lo limbs the same way
+	limb ql = divDC2by1(q, a + hi, b + hi, lo, tp);
+	divFixup(q, lo, ql, a, b, n, tp);
+
+	return qh;
+}
+
+// divide the bn + qn limbs of a by b where qn <= bn, writing qn
+// quotient limbs, returning the top quotient limb and leaving the
+// remainder in the low bn limbs of a
+static limb divBlock(limb *q, limb *a, int qn, const limb *b, int bn, limb *tp) {
+	if (qn < DC_DIV_THRESHOLD) {
+		return divBasecase(q, a, bn + qn, b, bn);
+	}
+
+	// divide the top 2 * qn limbs by the top qn limbs of b, then
+	// correct with the rest of b
+	limb qh = divDC2by1(q, a + bn - qn, b + bn - qn, qn, tp);
+	if (qn == bn) return qh;
+	return divFixup(q, qn, qh, a, b, bn, tp);
+}
+
+// Burnikel-Ziegler division of an limbs by bn limbs (an > bn, top
+// bit of b set). Writes an - bn limbs of q, returns the top quotient
+// limb and leaves the remainder in the low bn limbs of a
+static limb divDC(limb *q, limb *a, int an, const limb *b, int bn) {
+	limb *tp = allocate(bn);
+
+	// the quotient is produced in blocks of bn limbs from the top,
+	// with the odd-sized block first
+	int qn = an - bn;
+	int first = (qn - 1) % bn + 1;
+	int pos = qn - first;
+	limb qtop = divBlock(q + pos, a + pos, first, b, bn, tp);
+
+	// every later block divides a 2 * bn window whose top half is
+	// already reduced below b, so its top quotient limb is zero
+	for (pos -= bn; pos >= 0; pos -= bn) {
+		divDC2by1(q + pos, a + pos, b, bn, tp);
+	}
+
+	release(tp);
+	return qtop;
+}
+
+// size-dispatched division
+void divmod(limb *q, limb *r, const limb *a, int an, const limb *b, int bn) {
+	// normalize so the divisor's top bit is set; the dividend gets one
+	// extra limb to hold the bits shifted out of it
+	int shift = __builtin_clzll(b[bn - 1]);
+	limb *buf = allocate(an + 1 + bn);
+	limb *num = buf, *den = buf + an + 1;
+	if (shift > 0) {
+		shl(den, b, bn, shift);
+		num[an] = shl(num, a, an, shift);
+	}
+	else {
+		copy(den, b, bn);
+		copy(num, a, an);
+		num[an] = 0;
+	}
+
+	// num[an] < den[bn - 1], so the top quotient limb is always zero
+	if (bn < DC_DIV_THRESHOLD || an + 1 - bn < DC_DIV_THRESHOLD) {
+		divBasecase(q, num, an + 1, den, bn);
+	}
+	else {
+		divDC(q, num, an + 1, den, bn);
+	}
+
+	// undo the normalization on the remainder
+	if (shift > 0) {
+		shr(r, num, bn, shift);
+	}
+	else {
+		copy(r, num, bn);
+	}
+	release(buf);
+}
+
+// divisor length (in limbs) from which divmodPre() divides by
+// multiplying with the whole reciprocal; below it the two full
+// products per block cost more than Burnikel-Ziegler's recursion
+const int BARRETT_DIV_THRESHOLD = 1500;
+
+// set up division by the normalized n-limb magnitude b (b > 0)
+void divInit(DivInverse &inv, const limb *b, int n) {
+	inv.n = n;
+	inv.shift = __builtin_clzll(b[n - 1]);
+	inv.d = allocate(n);
+	if (inv.shift > 0) {
+		shl(inv.d, b, n, inv.shift);
+	}
+	else {
+		copy(inv.d, b, n);
+	}
+	inv.v = reciprocal(inv.d[n - 1]);
+	inv.mu = NULL;
+
+	if (n >= BARRETT_DIV_THRESHOLD) {
+		// mu = floor(B^(2n) / d), n + 1 limbs since d >= B^n / 2
+		limb *big = allocate(2 * n + 1);
+		limb *r = allocate(n);
+		zero(big, 2 * n);
+		big[2 * n] = 1;
+		inv.mu = allocate(n + 2);
+		divmod(inv.mu, r, big, 2 * n + 1, inv.d, n);
+		release(r);
+		release(big);
+	}
+}
+
+// free the divisor's constants
+void divFree(DivInverse &inv) {
+	release(inv.d);
+	if (inv.mu != NULL) release(inv.mu);
+}
+
+// divide the n + m limbs of w by d (1 <= m <= n) where the top n
+// limbs of w are below d: writes m limbs of q and leaves the
+// remainder in the low n limbs of w. tp is scratch of 4n + 2 limbs
+static void divBarrett(limb *q, limb *w, int m, DivInverse const& inv, limb *tp) {
+	int n = inv.n;
+
+	// q = floor(floor(w / B^(n-1)) * mu / B^(n+1)) is at most two
+	// short of floor(w / d)
+	limb *t = tp, *qm = tp + n + m + 2;
+	mul(t, inv.mu, n + 1, w + n - 1, m + 1);
+	copy(q, t + n + 1, m);
+	mul(qm, q, m, inv.d, n);
+
+	// the remainder is then below 3d, so n + 1 limbs hold it
+	sub(w, w, n + 1, qm, n + 1);
+	while (w[n] != 0 || cmp(w, n, inv.d, n) >= 0) {
+		w[n] -= sub(w, w, n, inv.d, n);
+		addTo(q, m, &ONE, 1);
+	}
+}
+
+// division by a prepared divisor
+void divmodPre(DivInverse const& inv, limb *q, limb *r, const limb *a, int an) {
+	int n = inv.n;
+	if (n == 1) {
+		r[0] = divmod1Pre(q, a, an, inv.d[0], inv.shift, inv.v);
+		return;
+	}
+
+	// shift the dividend to match the divisor; the extra top limb is
+	// below the divisor's top limb
+	limb *num = allocate(an + 1);
+	if (inv.shift > 0) {
+		num[an] = shl(num, a, an, inv.shift);
+	}
+	else {
+		copy(num, a, an);
+		num[an] = 0;
+	}
+
+	int qn = an + 1 - n;
+	if (inv.mu == NULL) {
+		// short divisors: the plain division, minus the setup
+		if (n < DC_DIV_THRESHOLD || qn < DC_DIV_THRESHOLD) {
+			divBasecase(q, num, an + 1, inv.d, n);
+		}
+		else {
+			divDC(q, num, an + 1, inv.d, n);
+		}
+	}
+	else {
+		// quotient blocks of n limbs from the top, the odd-sized one
+		// first; each leaves its remainder below the next block
+		limb *tp = allocate(4 * n + 2);
+		int first = (qn - 1) % n + 1;
+		int pos = qn - first;
+		divBarrett(q + pos, num + pos, first, inv, tp);
+		for (pos -= n; pos >= 0; pos -= n) {
+			divBarrett(q + pos, num + pos, n, inv, tp);
+		}
+		release(tp);
+	}
+
+	if (inv.shift > 0) {
+		shr(r, num, n, inv.shift);
+	}
+	else {
+		copy(r, num, n);
+	}
+	release(num);
+}
+
+// remainder by a prepared divisor
+void modPre(DivInverse const& inv, limb *r, const limb *a, int an) {
+	if (inv.n == 1) {
+		r[0] = mod1Pre(a, an, inv.d[0], inv.shift, inv.v);
+		return;
+	}
+	limb *q = allocate(an - inv.n + 1);
+	divmodPre(inv, q, r, a, an);
+	release(q);
+}
+
+}
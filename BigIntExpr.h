@@ -0,0 +1,182 @@
+/****************************************************************
+ * BigIntExpr.h -- fused evaluation of BigInt sums and products
+ ****************************************************************/
+#ifndef BIGINTEXPR_H
+#define BIGINTEXPR_H
+
+#include "BigInt.h"
+
+/*****************************************************************
+ * expression templates
+ *
+ * The ordinary operators build every intermediate result in a new
+ * array, so a + b + c or a * b + c costs two allocations and an
+ * extra pass over the data. Marking the first operand with lazy()
+ * switches to the operators below, which only record the operands:
+ *
+ *   BigInt d = lazy(a) * b + c - e;
+ *
+ * The whole sum is then computed into one result array by
+ * BigInt::fusedSum() when it is assigned to a BigInt. Terms may be
+ * BigInts or products of two of them; longs must be wrapped in
+ * BigInt first. The expression refers to its operands, so it must
+ * be evaluated within the statement that builds it (do not keep one
+ * in an 'auto' variable).
+ *
+ *****************************************************************/
+
+// a sum of N recorded terms, evaluated on conversion to BigInt
+template <int N>
+class BigIntSum {
+public:
+	BigInt::Term terms[N];
+
+	// evaluate the expression
+	operator BigInt() const {
+		return BigInt::fusedSum(terms, N);
+	}
+};
+
+// a single operand marked for lazy evaluation
+class BigIntLazy {
+public:
+	BigInt const& value;
+
+	explicit BigIntLazy(BigInt const& valueIn) : value(valueIn) {}
+};
+
+// start a lazily evaluated expression
+inline BigIntLazy lazy(BigInt const& value) {
+	return BigIntLazy(value);
+}
+
+// terms of x followed by those of y (negated if negateY is set)
+template <int N, int M>
+inline BigIntSum<N + M> joinSums(BigIntSum<N> const& x, BigIntSum<M> const& y, bool negateY) {
+	BigIntSum<N + M> s;
+	for (int i = 0; i < N; i++) {
+		s.terms[i] = x.terms[i];
+	}
+	for (int i = 0; i < M; i++) {
+		s.terms[N + i] = y.terms[i];
+		if (negateY) s.terms[N + i].negate = !s.terms[N + i].negate;
+	}
+	return s;
+}
+
+// one-term sum of a plain BigInt
+inline BigIntSum<1> termOf(BigInt const& value) {
+	BigIntSum<1> s = {{{&value, NULL, false}}};
+	return s;
+}
+
+// one-term sum of a product
+inline BigIntSum<1> productOf(BigInt const& a, BigInt const& b) {
+	BigIntSum<1> s = {{{&a, &b, false}}};
+	return s;
+}
+
+// multiplication records a product term
+inline BigIntSum<1> operator*(BigIntLazy const& x, BigInt const& y) {
+	return productOf(x.value, y);
+}
+
+inline BigIntSum<1> operator*(BigInt const& x, BigIntLazy const& y) {
+	return productOf(x, y.value);
+}
+
+inline BigIntSum<1> operator*(BigIntLazy const& x, BigIntLazy const& y) {
+	return productOf(x.value, y.value);
+}
+
+// addition of sums, lazy operands and plain BigInts
+template <int N, int M>
+inline BigIntSum<N + M> operator+(BigIntSum<N> const& x, BigIntSum<M> const& y) {
+	return joinSums(x, y, false);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator+(BigIntSum<N> const& x, BigInt const& y) {
+	return joinSums(x, termOf(y), false);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator+(BigInt const& x, BigIntSum<N> const& y) {
+	return joinSums(termOf(x), y, false);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator+(BigIntSum<N> const& x, BigIntLazy const& y) {
+	return joinSums(x, termOf(y.value), false);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator+(BigIntLazy const& x, BigIntSum<N> const& y) {
+	return joinSums(termOf(x.value), y, false);
+}
+
+inline BigIntSum<2> operator+(BigIntLazy const& x, BigInt const& y) {
+	return joinSums(termOf(x.value), termOf(y), false);
+}
+
+inline BigIntSum<2> operator+(BigInt const& x, BigIntLazy const& y) {
+	return joinSums(termOf(x), termOf(y.value), false);
+}
+
+inline BigIntSum<2> operator+(BigIntLazy const& x, BigIntLazy const& y) {
+	return joinSums(termOf(x.value), termOf(y.value), false);
+}
+
+// subtraction of sums, lazy operands and plain BigInts
+template <int N, int M>
+inline BigIntSum<N + M> operator-(BigIntSum<N> const& x, BigIntSum<M> const& y) {
+	return joinSums(x, y, true);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator-(BigIntSum<N> const& x, BigInt const& y) {
+	return joinSums(x, termOf(y), true);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator-(BigInt const& x, BigIntSum<N> const& y) {
+	return joinSums(termOf(x), y, true);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator-(BigIntSum<N> const& x, BigIntLazy const& y) {
+	return joinSums(x, termOf(y.value), true);
+}
+
+template <int N>
+inline BigIntSum<N + 1> operator-(BigIntLazy const& x, BigIntSum<N> const& y) {
+	return joinSums(termOf(x.value), y, true);
+}
+
+inline BigIntSum<2> operator-(BigIntLazy const& x, BigInt const& y) {
+	return joinSums(termOf(x.value), termOf(y), true);
+}
+
+inline BigIntSum<2> operator-(BigInt const& x, BigIntLazy const& y) {
+	return joinSums(termOf(x), termOf(y.value), true);
+}
+
+inline BigIntSum<2> operator-(BigIntLazy const& x, BigIntLazy const& y) {
+	return joinSums(termOf(x.value), termOf(y.value), true);
+}
+
+// negation flips every term
+template <int N>
+inline BigIntSum<N> operator-(BigIntSum<N> const& x) {
+	BigIntSum<N> s = x;
+	for (int i = 0; i < N; i++) {
+		s.terms[i].negate = !s.terms[i].negate;
+	}
+	return s;
+}
+
+inline BigIntSum<1> operator-(BigIntLazy const& x) {
+	return -termOf(x.value);
+}
+
+#endif
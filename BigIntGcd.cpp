@@ -0,0 +1,464 @@
+/****************************************************************
+ * BigIntGcd.cpp -- greatest common divisors
+ ****************************************************************/
+#include <stddef.h>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * gcd engine
+ *
+ * Euclid's algorithm is run in the form that reduces the larger of
+ * a and b by a multiple of the smaller, and the steps are collected
+ * in a matrix M of non-negative entries with determinant 1 such
+ * that (a, b) = M (a', b'). When one number reaches zero, a row of
+ * M^-1 holds the cofactors of the extended gcd.
+ *
+ * Lehmer's method finds most steps from the top 64 bits alone. The
+ * quotients found there go into a matrix of single limbs for as
+ * long as they are sure to leave the full numbers non-negative, and
+ * the matrix is then applied to the full numbers in one pass. Each
+ * pass over the data removes about 32 bits, where a division step
+ * removes only one quotient's worth.
+ *
+ * For long operands the half-gcd takes over. The matrix
+ * that reduces the top half of a and b to half its size is found
+ * recursively and applied to the full numbers by fast
+ * multiplication, twice per level, for O(M(n) log n) in place of
+ * O(n^2). Steps are only taken while both numbers stay at least
+ * B^s (s a little over half their size), which keeps the matrix
+ * small enough to be applied to the full numbers safely.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// size (in limbs) from which the half-gcd recurses instead of
+// stepping with Lehmer's method
+const int HGCD_THRESHOLD = 150;
+
+// sizes from which gcd() and gcdext() reduce by the half-gcd; the
+// extended gcd gets there sooner, as it would otherwise update its
+// matrix on every Lehmer step
+const int GCD_DC_THRESHOLD = 1000;
+const int GCDEXT_DC_THRESHOLD = 500;
+
+static const limb ONE = 1;
+
+// a 2x2 matrix of magnitudes; entry 2 * row + col has len[] limbs
+// and room for cap
+struct GcdMatrix {
+	limb *m[4];
+	int len[4];
+	int cap;
+};
+
+// the identity, with room for entries of cap limbs
+static void matInit(GcdMatrix &M, int cap) {
+	M.cap = cap;
+	for (int i = 0; i < 4; i++) {
+		M.m[i] = allocate(cap);
+		M.m[i][0] = (i == 0 || i == 3) ? 1 : 0;
+		M.len[i] = 1;
+	}
+}
+
+static void matFree(GcdMatrix &M) {
+	for (int i = 0; i < 4; i++) {
+		release(M.m[i]);
+	}
+}
+
+// r = x * p + y * q; returns the normalized length. r needs room
+// for max(xn + pn, yn + qn) + 1 limbs and tp for yn + qn
+static int mulAdd(limb *r, const limb *x, int xn, const limb *p, int pn, const limb *y, int yn, const limb *q, int qn, limb *tp) {
+	int n1 = xn + pn, n2 = yn + qn;
+	mul(r, x, xn, p, pn);
+	mul(tp, y, yn, q, qn);
+	if (n1 < n2) {
+		zero(r + n1, n2 - n1);
+		n1 = n2;
+	}
+	r[n1] = addTo(r, n1, tp, n2);
+	return normalize(r, n1 + 1);
+}
+
+// M = M * S
+static void matMul(GcdMatrix &M, GcdMatrix const& S) {
+	int sn = S.len[0];
+	for (int i = 1; i < 4; i++) {
+		if (S.len[i] > sn) sn = S.len[i];
+	}
+	int size = M.cap + sn + 1;
+	limb *t = allocate(3 * size);
+	limb *r0 = t, *r1 = t + size, *tp = t + 2 * size;
+	for (int row = 0; row < 2; row++) {
+		limb *x = M.m[2 * row], *y = M.m[2 * row + 1];
+		int xn = M.len[2 * row], yn = M.len[2 * row + 1];
+		int n0 = mulAdd(r0, x, xn, S.m[0], S.len[0], y, yn, S.m[2], S.len[2], tp);
+		int n1 = mulAdd(r1, x, xn, S.m[1], S.len[1], y, yn, S.m[3], S.len[3], tp);
+		copy(x, r0, n0);
+		copy(y, r1, n1);
+		M.len[2 * row] = n0;
+		M.len[2 * row + 1] = n1;
+	}
+	release(t);
+}
+
+// M = M * [u0 u1; u2 u3] for single limbs u
+static void matMul1(GcdMatrix &M, const limb *u) {
+	for (int row = 0; row < 2; row++) {
+		limb *x = M.m[2 * row], *y = M.m[2 * row + 1];
+		int n = M.len[2 * row];
+		if (M.len[2 * row + 1] > n) n = M.len[2 * row + 1];
+		zero(x + M.len[2 * row], n - M.len[2 * row]);
+		zero(y + M.len[2 * row + 1], n - M.len[2 * row + 1]);
+
+		// each new entry fits n + 1 limbs, so the top limbs of the two
+		// products cannot overflow when added
+		limb *t = allocate(n + 1);
+		t[n] = mul1(t, x, n, u[1]);
+		t[n] += addmul1(t, y, n, u[3]);
+		x[n] = mul1(x, x, n, u[0]);
+		x[n] += addmul1(x, y, n, u[2]);
+		copy(y, t, n + 1);
+		release(t);
+		M.len[2 * row] = normalize(x, n + 1);
+		M.len[2 * row + 1] = normalize(y, n + 1);
+	}
+}
+
+// add q times column src of M to column dst
+static void matAddColumn(GcdMatrix &M, int dst, int src, const limb *q, int qn) {
+	for (int row = 0; row < 2; row++) {
+		limb *e = M.m[2 * row + dst];
+		const limb *f = M.m[2 * row + src];
+		int en = M.len[2 * row + dst], fn = M.len[2 * row + src];
+		if (fn == 1 && f[0] == 0) continue;
+
+		limb *t = allocate(fn + qn);
+		mul(t, f, fn, q, qn);
+		int tn = normalize(t, fn + qn);
+		if (tn > en) {
+			zero(e + en, tn - en);
+			en = tn;
+		}
+		limb carry = addTo(e, en, t, tn);
+		if (carry != 0) e[en++] = carry;
+		M.len[2 * row + dst] = en;
+		release(t);
+	}
+}
+
+// (a, b) = M^-1 (a, b) over n limbs, which for determinant 1 is
+// (m11 a - m01 b, m00 b - m10 a); both are known to be non-negative
+static void matApplyInverse(GcdMatrix const& M, limb *a, limb *b, int n) {
+	int e = M.len[0];
+	for (int i = 1; i < 4; i++) {
+		if (M.len[i] > e) e = M.len[i];
+	}
+	int size = n + e;
+	limb *t = allocate(4 * size);
+	limb *p[4] = {t, t + size, t + 2 * size, t + 3 * size};
+	const limb *src[4] = {a, b, b, a};
+	const int entry[4] = {3, 1, 0, 2};
+	for (int i = 0; i < 4; i++) {
+		int k = entry[i];
+		mul(p[i], src[i], n, M.m[k], M.len[k]);
+		zero(p[i] + n + M.len[k], e - M.len[k]);
+	}
+	sub(p[0], p[0], size, p[1], size);
+	sub(p[2], p[2], size, p[3], size);
+	copy(a, p[0], n);
+	copy(b, p[2], n);
+	release(t);
+}
+
+// number of bits in a normalized nonzero magnitude
+static long bitLength(const limb *a, int an) {
+	return (long)(an - 1) * LIMB_BITS + (LIMB_BITS - __builtin_clzll(a[an - 1]));
+}
+
+// limbs in the larger of a and b (n limbs each)
+static int sizeOf(const limb *a, const limb *b, int n) {
+	int an = normalize(a, n), bn = normalize(b, n);
+	return (an > bn) ? an : bn;
+}
+
+// bits k to k + 63 of a
+static limb bitsAt(const limb *a, int an, long k) {
+	int i = (int)(k / LIMB_BITS), shift = (int)(k % LIMB_BITS);
+	if (i >= an) return 0;
+	limb v = a[i] >> shift;
+	if (shift > 0 && i + 1 < an) v |= a[i + 1] << (LIMB_BITS - shift);
+	return v;
+}
+
+// the Euclidean steps on the top bits ah, bh of two numbers whose
+// lower bits are unknown, as the matrix u (determinant 1) with
+// (ah, bh) = u (ah', bh'). A step is only taken while each new value
+// is at least the entry of u that multiplies the other one's unknown
+// bits in u^-1, so the full numbers stay non-negative. Returns false
+// if no step was possible
+static bool lehmerMatrix(limb ah, limb bh, limb *u) {
+	limb u0 = 1, u1 = 0, u2 = 0, u3 = 1;
+	bool any = false;
+	for (;;) {
+		if (ah >= bh) {
+			if (bh == 0) break;
+			limb q = (ah - bh < bh) ? 1 : ah / bh;
+			limb r = ah - q * bh;
+			dlimb n1 = (dlimb)q * u0 + u1, n3 = (dlimb)q * u2 + u3;
+			if ((n1 >> LIMB_BITS) != 0 || (n3 >> LIMB_BITS) != 0 || r < (limb)n1) break;
+			ah = r;
+			u1 = (limb)n1;
+			u3 = (limb)n3;
+		}
+		else {
+			if (ah == 0) break;
+			limb q = (bh - ah < ah) ? 1 : bh / ah;
+			limb r = bh - q * ah;
+			dlimb n0 = (dlimb)q * u1 + u0, n2 = (dlimb)q * u3 + u2;
+			if ((n0 >> LIMB_BITS) != 0 || (n2 >> LIMB_BITS) != 0 || r < (limb)n2) break;
+			bh = r;
+			u0 = (limb)n0;
+			u2 = (limb)n2;
+		}
+		any = true;
+	}
+	u[0] = u0;
+	u[1] = u1;
+	u[2] = u2;
+	u[3] = u3;
+	return any;
+}
+
+// reduce the larger of a and b modulo the smaller, recording the
+// quotient in M (if not NULL). With s > 0 the remainder must stay
+// at least B^s: one quotient less is taken when it would not, and
+// nothing is done (returning false) when that leaves no step
+static bool divStep(limb *a, int an, limb *b, int bn, int s, GcdMatrix *M) {
+	bool reduceA = cmp(a, an, b, bn) >= 0;
+	limb *x = reduceA ? a : b;
+	const limb *y = reduceA ? b : a;
+	int xn = reduceA ? an : bn, yn = reduceA ? bn : an;
+
+	int qn = xn - yn + 1;
+	limb *q = allocate(qn + yn + 1);
+	limb *r = q + qn;
+	if (yn == 1) {
+		r[0] = divmod1(q, x, xn, y[0]);
+	}
+	else {
+		divmod(q, r, x, xn, y, yn);
+	}
+	qn = normalize(q, qn);
+
+	int rn = yn;
+	if (s > 0 && normalize(r, yn) <= s) {
+		if (qn == 1 && q[0] == 1) {
+			release(q);
+			return false;
+		}
+		// r + y is at least y, so at least B^s, and at most x
+		subFrom(q, qn, &ONE, 1);
+		qn = normalize(q, qn);
+		r[yn] = addTo(r, yn, y, yn);
+		if (xn > yn) rn++;
+	}
+	copy(x, r, rn);
+	zero(x + rn, xn - rn);
+
+	if (M != NULL) {
+		// reducing a adds q times column 0 to column 1, and vice versa
+		matAddColumn(*M, reduceA ? 1 : 0, reduceA ? 0 : 1, q, qn);
+	}
+	release(q);
+	return true;
+}
+
+// one reduction of a and b (n limbs, both nonzero): a Lehmer pass
+// if the top bits allow one, otherwise a division step. With s > 0
+// both numbers must stay at least B^s; returns false if no step
+// was possible
+static bool gcdStep(limb *a, limb *b, int n, int s, GcdMatrix *M) {
+	int an = normalize(a, n), bn = normalize(b, n);
+	long top = bitLength(a, an);
+	if (bitLength(b, bn) > top) top = bitLength(b, bn);
+	long k = (top > LIMB_BITS) ? top - LIMB_BITS : 0;
+
+	limb u[4];
+	if (lehmerMatrix(bitsAt(a, an, k), bitsAt(b, bn, k), u)) {
+		// (a, b) = u^-1 (a, b) = (u3 a - u1 b, u0 b - u2 a); the high
+		// limbs of each pair of products cancel
+		limb *t = allocate(2 * n);
+		mul1(t, a, n, u[3]);
+		submul1(t, b, n, u[1]);
+		mul1(t + n, b, n, u[0]);
+		submul1(t + n, a, n, u[2]);
+		if (s == 0 || (normalize(t, n) > s && normalize(t + n, n) > s)) {
+			copy(a, t, n);
+			copy(b, t + n, n);
+			release(t);
+			if (M != NULL) matMul1(*M, u);
+			return true;
+		}
+		release(t);
+	}
+	return divStep(a, an, b, bn, s, M);
+}
+
+static int hgcd(limb *a, limb *b, int n, GcdMatrix &M);
+
+// hgcd on the top n - p limbs of a and b (n limbs), applied to the
+// full numbers and appended to M; returns false if it found no step
+static bool hgcdTop(limb *a, limb *b, int n, int p, GcdMatrix &M) {
+	int m = n - p;
+	limb *t = allocate(2 * m);
+	copy(t, a + p, m);
+	copy(t + m, b + p, m);
+	GcdMatrix H;
+	matInit(H, m + 2);
+	bool found = hgcd(t, t + m, m, H) > 0;
+	if (found) {
+		matApplyInverse(H, a, b, n);
+		matMul(M, H);
+	}
+	matFree(H);
+	release(t);
+	return found;
+}
+
+// the half-gcd: reduce a and b (n limbs) for as long as both stay
+// at least B^s with s = n / 2 + 1, recording the steps in M (which
+// starts as the identity, with room for n + 2 limbs). Returns the
+// new size, or 0 if no step was possible
+static int hgcd(limb *a, limb *b, int n, GcdMatrix &M) {
+	int s = n / 2 + 1;
+	if (normalize(a, n) <= s || normalize(b, n) <= s) return 0;
+	int size = sizeOf(a, b, n);
+
+	bool progress = false;
+	if (n >= HGCD_THRESHOLD) {
+		// the top half reduced to a quarter leaves about 3n/4 limbs
+		if (hgcdTop(a, b, n, n / 2, M)) progress = true;
+		size = sizeOf(a, b, n);
+
+		// a few single steps if that fell short
+		int n2 = 3 * n / 4 + 1;
+		while (size > n2 && gcdStep(a, b, size, s, &M)) {
+			progress = true;
+			size = sizeOf(a, b, size);
+		}
+
+		// then the top 2 (size - s) limbs reduced by half, which takes
+		// the numbers down to about s
+		if (size > s + 2) {
+			if (hgcdTop(a, b, size, 2 * s - size + 1, M)) progress = true;
+			size = sizeOf(a, b, size);
+		}
+	}
+
+	while (gcdStep(a, b, size, s, &M)) {
+		progress = true;
+		size = sizeOf(a, b, size);
+	}
+	return progress ? size : 0;
+}
+
+// reduce a and b (n limbs, both nonzero) until one of them is zero,
+// recording the steps in M if it is not NULL; returns true if the
+// gcd is left in a, false if in b
+static bool gcdReduce(limb *a, limb *b, int n, GcdMatrix *M) {
+	int threshold = (M != NULL) ? GCDEXT_DC_THRESHOLD : GCD_DC_THRESHOLD;
+	for (;;) {
+		int an = normalize(a, n), bn = normalize(b, n);
+		if (an == 1 && a[0] == 0) return false;
+		if (bn == 1 && b[0] == 0) return true;
+		n = (an > bn) ? an : bn;
+
+		if (n >= threshold) {
+			GcdMatrix H;
+			matInit(H, n + 2);
+			bool found = hgcd(a, b, n, H) > 0;
+			if (found && M != NULL) matMul(*M, H);
+			matFree(H);
+			if (found) continue;
+		}
+		gcdStep(a, b, n, 0, M);
+	}
+}
+
+// gcd of two single limbs (binary method)
+static limb gcd1(limb a, limb b) {
+	if (a == 0) return b;
+	if (b == 0) return a;
+	int shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	while (b != 0) {
+		b >>= __builtin_ctzll(b);
+		if (a > b) {
+			limb t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	}
+	return a << shift;
+}
+
+// greatest common divisor
+int gcd(limb *g, const limb *a, int an, const limb *b, int bn) {
+	an = normalize(a, an);
+	bn = normalize(b, bn);
+	if (an == 1 && bn == 1) {
+		g[0] = gcd1(a[0], b[0]);
+		return 1;
+	}
+
+	int n = (an > bn) ? an : bn;
+	limb *x = allocate(2 * n), *y = x + n;
+	copy(x, a, an);
+	zero(x + an, n - an);
+	copy(y, b, bn);
+	zero(y + bn, n - bn);
+	const limb *r = gcdReduce(x, y, n, NULL) ? x : y;
+	int gn = normalize(r, n);
+	copy(g, r, gn);
+	release(x);
+	return gn;
+}
+
+// extended gcd: the steps are recorded in M, and with the gcd in a
+// (so b = 0) the first row of M^-1 = [m11 -m01; -m10 m00] gives
+// g = m11 a - m01 b, while with the gcd in b the second row gives
+// g = m00 b - m10 a
+int gcdext(limb *g, limb *x, int &xn, limb *y, int &yn, bool &flip, const limb *a, int an, const limb *b, int bn) {
+	an = normalize(a, an);
+	bn = normalize(b, bn);
+	int n = (an > bn) ? an : bn;
+	limb *u = allocate(2 * n), *v = u + n;
+	copy(u, a, an);
+	zero(u + an, n - an);
+	copy(v, b, bn);
+	zero(v + bn, n - bn);
+
+	GcdMatrix M;
+	matInit(M, n + 2);
+	bool inA = gcdReduce(u, v, n, &M);
+	const limb *r = inA ? u : v;
+	int gn = normalize(r, n);
+	copy(g, r, gn);
+
+	int xi = inA ? 3 : 2, yi = inA ? 1 : 0;
+	xn = M.len[xi];
+	yn = M.len[yi];
+	copy(x, M.m[xi], xn);
+	copy(y, M.m[yi], yn);
+	flip = !inA;
+
+	matFree(M);
+	release(u);
+	return gn;
+}
+
+}
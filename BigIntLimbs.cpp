@@ -0,0 +1,490 @@
+/****************************************************************
+ * BigIntLimbs.cpp -- low-level limb-array kernels for BigInt
+ ****************************************************************/
+#include "BigIntLimbs.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LIMBS_X86 1
+#include <immintrin.h>
+#else
+#define LIMBS_X86 0
+#endif
+
+/*****************************************************************
+ * CPU-specific kernels
+ *
+ * On x86-64 the carry chains of add/sub use the adc/sbb
+ * instructions through the _addcarry_u64/_subborrow_u64 intrinsics
+ * (part of the baseline instruction set, so no dispatch is needed).
+ * Comparison scans from the top several limbs at a time with
+ * AVX2 or AVX-512 when the CPU has them; the variant is picked once
+ * at run time, and other platforms use the portable loops.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// compare equal-length magnitudes, most significant limb first
+static int cmpPortable(const limb *a, const limb *b, int n) {
+	for (int i = n - 1; i >= 0; i--) {
+		if (a[i] != b[i]) return (a[i] > b[i]) ? 1 : -1;
+	}
+	return 0;
+}
+
+#if LIMBS_X86
+__attribute__((target("avx2")))
+static int cmpAvx2(const limb *a, const limb *b, int n) {
+	int i = n;
+	for (; i >= 4; i -= 4) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i - 4));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i - 4));
+		int same = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(va, vb)));
+		if (same != 0xF) {
+			// the highest lane that differs decides
+			int j = i - 4 + (31 - __builtin_clz(~same & 0xF));
+			return (a[j] > b[j]) ? 1 : -1;
+		}
+	}
+	return cmpPortable(a, b, i);
+}
+
+__attribute__((target("avx512f")))
+static int cmpAvx512(const limb *a, const limb *b, int n) {
+	int i = n;
+	for (; i >= 8; i -= 8) {
+		__m512i va = _mm512_loadu_si512((const void *)(a + i - 8));
+		__m512i vb = _mm512_loadu_si512((const void *)(b + i - 8));
+		unsigned differ = _mm512_cmpneq_epu64_mask(va, vb);
+		if (differ != 0) {
+			int j = i - 8 + (31 - __builtin_clz(differ));
+			return (a[j] > b[j]) ? 1 : -1;
+		}
+	}
+	return cmpPortable(a, b, i);
+}
+#endif
+
+typedef int (*CmpKernel)(const limb *a, const limb *b, int n);
+
+// the best comparison kernel this CPU supports
+static CmpKernel pickCmp() {
+#if LIMBS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return cmpAvx512;
+	if (__builtin_cpu_supports("avx2")) return cmpAvx2;
+#endif
+	return cmpPortable;
+}
+
+// copy n limbs
+void copy(limb *r, const limb *a, int n) {
+	for (int i = 0; i < n; i++) {
+		r[i] = a[i];
+	}
+}
+
+// zero n limbs
+void zero(limb *r, int n) {
+	for (int i = 0; i < n; i++) {
+		r[i] = 0;
+	}
+}
+
+// strip leading zero limbs
+int normalize(const limb *a, int n) {
+	while (n > 1 && a[n - 1] == 0) {
+		n--;
+	}
+	return n;
+}
+
+// compare normalized magnitudes
+int cmp(const limb *a, int an, const limb *b, int bn) {
+	// the longer number is larger
+	if (an != bn) return (an > bn) ? 1 : -1;
+
+	// same length, so compare by limb (most significant first)
+	static const CmpKernel kernel = pickCmp();
+	return kernel(a, b, an);
+}
+
+// multi-limb addition
+limb add(limb *r, const limb *a, int an, const limb *b, int bn) {
+#if LIMBS_X86
+	unsigned char carry = 0;
+	unsigned long long s;
+	int i = 0;
+	// add limbs from right to left on the hardware carry chain
+	for (; i + 4 <= bn; i += 4) {
+		carry = _addcarry_u64(carry, a[i], b[i], &s);
+		r[i] = s;
+		carry = _addcarry_u64(carry, a[i + 1], b[i + 1], &s);
+		r[i + 1] = s;
+		carry = _addcarry_u64(carry, a[i + 2], b[i + 2], &s);
+		r[i + 2] = s;
+		carry = _addcarry_u64(carry, a[i + 3], b[i + 3], &s);
+		r[i + 3] = s;
+	}
+	for (; i < bn; i++) {
+		carry = _addcarry_u64(carry, a[i], b[i], &s);
+		r[i] = s;
+	}
+	// propagate the carry through the rest of a
+	for (; i < an; i++) {
+		carry = _addcarry_u64(carry, a[i], 0, &s);
+		r[i] = s;
+	}
+	return carry;
+#else
+	limb carry = 0;
+	int i = 0;
+	// add limbs from right to left, carrying appropriately
+	for (; i < bn; i++) {
+		limb s = a[i] + carry;
+		carry = (s < carry);
+		r[i] = s + b[i];
+		carry += (r[i] < s);
+	}
+	// propagate the carry through the rest of a
+	for (; i < an; i++) {
+		r[i] = a[i] + carry;
+		carry = (r[i] < carry);
+	}
+	return carry;
+#endif
+}
+
+// multi-limb subtraction
+limb sub(limb *r, const limb *a, int an, const limb *b, int bn) {
+#if LIMBS_X86
+	unsigned char borrow = 0;
+	unsigned long long d;
+	int i = 0;
+	// subtract limbs from right to left on the hardware borrow chain
+	for (; i + 4 <= bn; i += 4) {
+		borrow = _subborrow_u64(borrow, a[i], b[i], &d);
+		r[i] = d;
+		borrow = _subborrow_u64(borrow, a[i + 1], b[i + 1], &d);
+		r[i + 1] = d;
+		borrow = _subborrow_u64(borrow, a[i + 2], b[i + 2], &d);
+		r[i + 2] = d;
+		borrow = _subborrow_u64(borrow, a[i + 3], b[i + 3], &d);
+		r[i + 3] = d;
+	}
+	for (; i < bn; i++) {
+		borrow = _subborrow_u64(borrow, a[i], b[i], &d);
+		r[i] = d;
+	}
+	// propagate the borrow through the rest of a
+	for (; i < an; i++) {
+		borrow = _subborrow_u64(borrow, a[i], 0, &d);
+		r[i] = d;
+	}
+	return borrow;
+#else
+	limb borrow = 0;
+	int i = 0;
+	// subtract limbs from right to left, borrowing appropriately
+	for (; i < bn; i++) {
+		limb d = a[i] - b[i];
+		limb nextBorrow = (a[i] < b[i]);
+		nextBorrow += (d < borrow);
+		r[i] = d - borrow;
+		borrow = nextBorrow;
+	}
+	// propagate the borrow through the rest of a
+	for (; i < an; i++) {
+		limb ai = a[i];
+		r[i] = ai - borrow;
+		borrow = (ai < borrow);
+	}
+	return borrow;
+#endif
+}
+
+// in-place addition, stopping as soon as the carry dies out
+limb addTo(limb *r, int rn, const limb *b, int bn) {
+	limb carry = add(r, r, bn, b, bn);
+	int i = bn;
+	for (; carry != 0 && i < rn; i++) {
+		r[i]++;
+		carry = (r[i] == 0);
+	}
+	return carry;
+}
+
+// carry-save addition: every limb is independent of the others, so
+// the loop has no carry chain to wait on
+void addCarrySave(limb *sum, limb *carry, const limb *a, int n) {
+	for (int i = 0; i < n; i++) {
+		limb s = sum[i] + a[i];
+		carry[i + 1] += (s < a[i]);
+		sum[i] = s;
+	}
+}
+
+// fold the carry counts into the limbs with one carry chain
+limb carrySaveResolve(limb *sum, limb *carry, int n) {
+	limb c = 0;
+	for (int i = 0; i < n; i++) {
+		dlimb t = (dlimb)sum[i] + carry[i] + c;
+		sum[i] = (limb)t;
+		c = (limb)(t >> LIMB_BITS);
+		carry[i] = 0;
+	}
+	c += carry[n];
+	carry[n] = 0;
+	return c;
+}
+
+// in-place subtraction, stopping as soon as the borrow dies out
+limb subFrom(limb *r, int rn, const limb *b, int bn) {
+	limb borrow = sub(r, r, bn, b, bn);
+	int i = bn;
+	for (; borrow != 0 && i < rn; i++) {
+		borrow = (r[i] == 0);
+		r[i]--;
+	}
+	return borrow;
+}
+
+// multiply by a single limb
+limb mul1(limb *r, const limb *a, int n, limb m) {
+	limb carry = 0;
+	for (int i = 0; i < n; i++) {
+		dlimb p = (dlimb)a[i] * m + carry;
+		r[i] = (limb)p;
+		carry = (limb)(p >> LIMB_BITS);
+	}
+	return carry;
+}
+
+// multiply by a single limb and accumulate
+limb addmul1(limb *r, const limb *a, int n, limb m) {
+	limb carry = 0;
+	for (int i = 0; i < n; i++) {
+		dlimb p = (dlimb)a[i] * m + r[i] + carry;
+		r[i] = (limb)p;
+		carry = (limb)(p >> LIMB_BITS);
+	}
+	return carry;
+}
+
+// multiply by a single limb and subtract
+limb submul1(limb *r, const limb *a, int n, limb m) {
+	limb borrow = 0;
+	for (int i = 0; i < n; i++) {
+		dlimb p = (dlimb)a[i] * m + borrow;
+		limb lo = (limb)p;
+		borrow = (limb)(p >> LIMB_BITS);
+		limb ri = r[i];
+		r[i] = ri - lo;
+		borrow += (ri < lo);
+	}
+	return borrow;
+}
+
+// schoolbook multiplication
+void mulBasecase(limb *r, const limb *a, int an, const limb *b, int bn) {
+	// the first row initializes the result, the rest accumulate
+	r[an] = mul1(r, a, an, b[0]);
+	for (int j = 1; j < bn; j++) {
+		r[an + j] = addmul1(r + j, a, an, b[j]);
+	}
+}
+
+// schoolbook squaring
+void sqrBasecase(limb *r, const limb *a, int n) {
+	// cross products a[i] * a[j] for i < j, each computed once
+	r[0] = 0;
+	r[2 * n - 1] = 0;
+	if (n > 1) {
+		r[n] = mul1(r + 1, a + 1, n - 1, a[0]);
+		for (int i = 1; i < n - 1; i++) {
+			r[n + i] = addmul1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+		}
+		// every cross product appears twice in the square
+		shl(r, r, 2 * n, 1);
+	}
+
+	// add in the squares a[i]^2 down the diagonal
+	limb carry = 0;
+	for (int i = 0; i < n; i++) {
+		dlimb sq = (dlimb)a[i] * a[i];
+		dlimb s = (dlimb)r[2 * i] + (limb)sq + carry;
+		r[2 * i] = (limb)s;
+		s = (dlimb)r[2 * i + 1] + (limb)(sq >> LIMB_BITS) + (limb)(s >> LIMB_BITS);
+		r[2 * i + 1] = (limb)s;
+		carry = (limb)(s >> LIMB_BITS);
+	}
+}
+
+// shift left by less than a limb
+limb shl(limb *r, const limb *a, int n, int bits) {
+	limb out = a[n - 1] >> (LIMB_BITS - bits);
+	for (int i = n - 1; i > 0; i--) {
+		r[i] = (a[i] << bits) | (a[i - 1] >> (LIMB_BITS - bits));
+	}
+	r[0] = a[0] << bits;
+	return out;
+}
+
+// shift right by less than a limb
+limb shr(limb *r, const limb *a, int n, int bits) {
+	limb out = a[0] << (LIMB_BITS - bits);
+	for (int i = 0; i < n - 1; i++) {
+		r[i] = (a[i] >> bits) | (a[i + 1] << (LIMB_BITS - bits));
+	}
+	r[n - 1] = a[n - 1] >> bits;
+	return out;
+}
+
+// reciprocal of a normalized divisor: floor((B^2 - 1) / d) - B
+limb reciprocal(limb d) {
+	return (limb)((((dlimb)~d << LIMB_BITS) | ~(limb)0) / d);
+}
+
+// divide u1:u0 by a normalized d with u1 < d, given v = reciprocal(d)
+// (Moller-Granlund), avoiding a hardware 128-bit division
+static inline limb div2by1(limb &rem, limb u1, limb u0, limb d, limb v) {
+	dlimb q = (dlimb)v * u1 + (((dlimb)u1 << LIMB_BITS) | u0);
+	limb q1 = (limb)(q >> LIMB_BITS) + 1;
+	limb r = u0 - q1 * d;
+	if (r > (limb)q) {
+		q1--;
+		r += d;
+	}
+	if (r >= d) {
+		q1++;
+		r -= d;
+	}
+	rem = r;
+	return q1;
+}
+
+// divide by a single limb
+limb divmod1(limb *q, const limb *a, int n, limb d) {
+	// normalize d so the reciprocal can stand in for hardware
+	// division
+	int shift = __builtin_clzll(d);
+	d <<= shift;
+	return divmod1Pre(q, a, n, d, shift, reciprocal(d));
+}
+
+// divide by a single normalized limb with a known reciprocal,
+// shifting the dividend limbs to match on the fly
+limb divmod1Pre(limb *q, const limb *a, int n, limb d, int shift, limb v) {
+	limb rem = 0;
+	if (shift > 0) {
+		rem = a[n - 1] >> (LIMB_BITS - shift);
+	}
+	// bring down one limb at a time (most significant first)
+	for (int i = n - 1; i >= 0; i--) {
+		limb cur = a[i] << shift;
+		if (shift > 0 && i > 0) cur |= a[i - 1] >> (LIMB_BITS - shift);
+		q[i] = div2by1(rem, rem, cur, d, v);
+	}
+	return rem >> shift;
+}
+
+// remainder by a single limb
+limb mod1(const limb *a, int n, limb d) {
+	int shift = __builtin_clzll(d);
+	d <<= shift;
+	return mod1Pre(a, n, d, shift, reciprocal(d));
+}
+
+// remainder by a single normalized limb with a known reciprocal
+limb mod1Pre(const limb *a, int n, limb d, int shift, limb v) {
+	limb rem = 0;
+	if (shift > 0) {
+		rem = a[n - 1] >> (LIMB_BITS - shift);
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		limb cur = a[i] << shift;
+		if (shift > 0 && i > 0) cur |= a[i - 1] >> (LIMB_BITS - shift);
+		div2by1(rem, rem, cur, d, v);
+	}
+	return rem >> shift;
+}
+
+// exact division by a single limb
+void divexact1(limb *q, const limb *a, int n, limb d) {
+	// strip the even part of d with a shift
+	int shift = 0;
+	while ((d & 1) == 0) {
+		d >>= 1;
+		shift++;
+	}
+
+	// inverse of the odd part mod 2^64 by Newton iteration
+	limb inv = d; // correct to 3 bits
+	for (int i = 0; i < 5; i++) {
+		inv *= 2 - d * inv;
+	}
+
+	// Hensel division from the low end: each quotient limb is the
+	// current limb times the inverse, and the high half of q*d is
+	// carried into the next limb
+	limb borrow = 0;
+	for (int i = 0; i < n; i++) {
+		limb cur = a[i] - borrow;
+		borrow = (a[i] < borrow);
+		limb qi = cur * inv;
+		q[i] = qi;
+		borrow += (limb)(((dlimb)qi * d) >> LIMB_BITS);
+	}
+
+	if (shift > 0) shr(q, q, n, shift);
+}
+
+// schoolbook division by a normalized divisor (Knuth's Algorithm D)
+limb divBasecase(limb *q, limb *a, int an, const limb *b, int bn) {
+	limb d1 = b[bn - 1], d0 = b[bn - 2];
+	limb v = reciprocal(d1);
+
+	// the top quotient limb is 0 or 1 because b is normalized
+	limb qtop = 0;
+	if (cmp(a + an - bn, bn, b, bn) >= 0) {
+		sub(a + an - bn, a + an - bn, bn, b, bn);
+		qtop = 1;
+	}
+
+	for (int j = an - bn - 1; j >= 0; j--) {
+		limb n2 = a[j + bn], n1 = a[j + bn - 1], n0 = a[j + bn - 2];
+
+		// estimate the quotient limb from the top two limbs of the
+		// divisor; the estimate is at most one too large unless the
+		// top limbs matched, in which case it is at most two too large
+		limb qhat;
+		if (n2 >= d1) {
+			qhat = ~(limb)0;
+		}
+		else {
+			limb rhat;
+			qhat = div2by1(rhat, n2, n1, d1, v);
+			while ((dlimb)qhat * d0 > (((dlimb)rhat << LIMB_BITS) | n0)) {
+				qhat--;
+				rhat += d1;
+				if (rhat < d1) break; // rhat overflowed, so the test holds
+			}
+		}
+
+		// subtract qhat * b from the current window, adding b back
+		// until the window is non-negative again
+		limb borrow = submul1(a + j, b, bn, qhat);
+		limb top = a[j + bn];
+		a[j + bn] = top - borrow;
+		if (top < borrow) {
+			do {
+				qhat--;
+			} while (addTo(a + j, bn + 1, b, bn) == 0);
+		}
+		q[j] = qhat;
+	}
+
+	return qtop;
+}
+
+}
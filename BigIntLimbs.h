@@ -0,0 +1,303 @@
+/****************************************************************
+ * BigIntLimbs.h -- low-level limb-array kernels for BigInt
+ ****************************************************************/
+#ifndef BIGINTLIMBS_H
+#define BIGINTLIMBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************
+ * limbs namespace
+ *
+ * Magnitudes are stored as arrays of 64-bit binary "limbs", least
+ * significant limb first. None of these routines know anything
+ * about signs, infinity or undefined values; they work on raw
+ * buffers supplied by the caller, and BigInt layers its semantics
+ * on top of them.
+ *
+ * Unless stated otherwise a length is a count of limbs, and an
+ * "a, an" pair must satisfy an >= 1.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+typedef uint64_t limb; // one binary digit of a magnitude
+typedef unsigned __int128 dlimb; // double-width intermediate
+
+const int LIMB_BITS = 64;
+
+// a pluggable source of memory for limb arrays. The array handed
+// out by allocate() is tagged with the allocator that made it, so
+// release() always returns it to the right one, even after the
+// thread has switched allocators
+class Allocator {
+public:
+	virtual ~Allocator() {}
+
+	// return room for n limbs
+	virtual limb *allocate(int n) = 0;
+
+	// take back the n-limb block p returned by allocate(n)
+	virtual void release(limb *p, int n) = 0;
+};
+
+// make alloc the source of new arrays on the calling thread (NULL
+// means the heap) and return the previous one
+Allocator *setAllocator(Allocator *alloc);
+
+// allocate an array of n limbs from the thread's current allocator
+// (by default a per-thread cache of heap blocks; see BigIntAlloc.cpp)
+limb *allocate(int n);
+
+// allocate an array of n limbs from the heap whatever the current
+// allocator is (for caches that outlive any allocator scope)
+limb *allocateHeap(int n);
+
+// return an array obtained from allocate() to its allocator
+void release(limb *p);
+
+// one piece of work for runTasks(): run(arg)
+struct Task {
+	void (*run)(void *arg);
+	void *arg;
+};
+
+// run count independent tasks and return once they have all
+// finished. When the calling thread's concurrency allows, the pool's
+// worker threads take some of them while the caller runs the rest
+// (see BigIntThread.cpp)
+void runTasks(Task const *tasks, int count);
+
+// give the pool n threads in all, counting the caller (1 keeps all
+// work on the calling thread), and return the previous count. Must
+// not be called while any thread is computing
+int setThreads(int n);
+
+// limit work started on the calling thread to n threads (0 lifts the
+// limit) and return the previous limit
+int setConcurrency(int n);
+
+// threads the calling thread's work may use: the pool size, or its
+// own limit if that is lower
+int concurrency();
+
+// copy n limbs from a to r
+void copy(limb *r, const limb *a, int n);
+
+// set n limbs of r to zero
+void zero(limb *r, int n);
+
+// length of a with leading zero limbs stripped (never less than 1)
+int normalize(const limb *a, int n);
+
+// compare two normalized magnitudes, returning -1, 0 or 1
+int cmp(const limb *a, int an, const limb *b, int bn);
+
+// r = a + b where an >= bn; writes an limbs and returns the carry
+// (r may alias a)
+limb add(limb *r, const limb *a, int an, const limb *b, int bn);
+
+// r = a - b where an >= bn; writes an limbs and returns the borrow
+// (r may alias a, or b when an == bn)
+limb sub(limb *r, const limb *a, int an, const limb *b, int bn);
+
+// r += b where rn >= bn; returns the carry out of rn limbs
+// (stops early once the carry dies out)
+limb addTo(limb *r, int rn, const limb *b, int bn);
+
+// r -= b where rn >= bn; returns the borrow out of rn limbs
+// (stops early once the borrow dies out)
+limb subFrom(limb *r, int rn, const limb *b, int bn);
+
+// sum += a over n limbs without propagating carries: the carry out
+// of limb i is counted in carry[i + 1] instead (carry has n + 1
+// entries). The counts must be resolved before they can overflow
+void addCarrySave(limb *sum, limb *carry, const limb *a, int n);
+
+// fold the counts of carry[0..n] into sum, clearing them, and
+// return what carries out of the top limb (counts below 2^63 keep
+// this within one limb)
+limb carrySaveResolve(limb *sum, limb *carry, int n);
+
+// r = a * m; writes n limbs and returns the high limb
+limb mul1(limb *r, const limb *a, int n, limb m);
+
+// r += a * m over n limbs and returns the high limb
+limb addmul1(limb *r, const limb *a, int n, limb m);
+
+// r -= a * m over n limbs and returns the borrowed high limb
+limb submul1(limb *r, const limb *a, int n, limb m);
+
+// r = a * b by the schoolbook method where an >= bn; writes an + bn
+// limbs (r must not overlap a or b)
+void mulBasecase(limb *r, const limb *a, int an, const limb *b, int bn);
+
+// r = a * b; writes an + bn limbs (r must not overlap a or b).
+// Dispatches on operand size to schoolbook, Karatsuba, Toom-3,
+// Toom-4 or NTT multiplication (see BigIntMul.cpp), and to sqr()
+// when a and b are the same operand
+void mul(limb *r, const limb *a, int an, const limb *b, int bn);
+
+// r = a * a by the schoolbook method, computing each cross product
+// once; writes 2n limbs (r must not overlap a)
+void sqrBasecase(limb *r, const limb *a, int n);
+
+// r = a * a; writes 2n limbs (r must not overlap a). Dispatches on
+// size like mul(), using the squaring variant of each tier
+void sqr(limb *r, const limb *a, int n);
+
+// r = a * b by three-prime number-theoretic transform; writes an + bn
+// limbs (r must not overlap a or b). Transforms a only once when b
+// is the same operand
+void mulNtt(limb *r, const limb *a, int an, const limb *b, int bn);
+
+// r = a << bits (0 < bits < LIMB_BITS); returns bits shifted out
+limb shl(limb *r, const limb *a, int n, int bits);
+
+// r = a >> bits (0 < bits < LIMB_BITS); returns bits shifted out
+// (left-aligned in the returned limb)
+limb shr(limb *r, const limb *a, int n, int bits);
+
+// q = a / d, returning a % d; writes n limbs of q (q may alias a)
+limb divmod1(limb *q, const limb *a, int n, limb d);
+
+// a % d, without producing the quotient
+limb mod1(const limb *a, int n, limb d);
+
+// reciprocal floor((2^128 - 1) / d) - 2^64 of a d with its top bit
+// set, which lets the *Pre routines divide by d without hardware
+// division
+limb reciprocal(limb d);
+
+// divmod1() and mod1() for a divisor already shifted left by shift
+// bits so its top bit is set, with v = reciprocal(d)
+limb divmod1Pre(limb *q, const limb *a, int n, limb d, int shift, limb v);
+limb mod1Pre(const limb *a, int n, limb d, int shift, limb v);
+
+// q = a / d where d is known to divide a exactly; writes n limbs
+// of q (q may alias a). Avoids hardware division entirely
+void divexact1(limb *q, const limb *a, int n, limb d);
+
+// q = a / b by Knuth's Algorithm D, where bn >= 2, an >= bn and the
+// top bit of b is set. Writes an - bn limbs of q, returns the top
+// quotient limb (0 or 1) and leaves a % b in the low bn limbs of a
+limb divBasecase(limb *q, limb *a, int an, const limb *b, int bn);
+
+// q = a / b, r = a % b where a >= b and b is normalized with bn >= 2;
+// writes an - bn + 1 limbs of q and bn limbs of r. Dispatches on
+// operand size to schoolbook or divide-and-conquer division (see
+// BigIntDiv.cpp)
+void divmod(limb *q, limb *r, const limb *a, int an, const limb *b, int bn);
+
+// g = gcd(a, b) for nonzero a and b by Lehmer's method, or by the
+// half-gcd for long operands (see BigIntGcd.cpp); writes at most
+// min(an, bn) limbs and returns the length of g
+int gcd(limb *g, const limb *a, int an, const limb *b, int bn);
+
+// g = gcd(a, b) for nonzero a and b together with cofactors
+// x <= b / g and y <= a / g (at most bn and an limbs) such that
+// g = x a - y b, or g = y b - x a when flip is set. Returns the
+// length of g
+int gcdext(limb *g, limb *x, int &xn, limb *y, int &yn, bool &flip, const limb *a, int an, const limb *b, int bn);
+
+// r = the product of the count nonzero one-limb factors f, which are
+// packed several to a limb (overwriting f) and multiplied in a
+// balanced tree; writes at most count limbs and returns the
+// normalized length (see BigIntComb.cpp)
+int product1(limb *r, limb *f, int count);
+
+// r = the product of count nonzero normalized magnitudes a[i] of
+// an[i] limbs, multiplied in pairs level by level; r needs room for
+// the sum of the an[i] limbs. Returns the normalized length
+int productMany(limb *r, const limb *const *a, const int *an, int count);
+
+// n!, C(n, k) for k <= n, and the product of the primes up to n,
+// each built from prime powers by balanced product trees into a new
+// array from allocate(), with its normalized length stored in rn
+// (see BigIntComb.cpp)
+limb *factorial(unsigned long n, int &rn);
+limb *binomial(unsigned long n, unsigned long k, int &rn);
+limb *primorial(unsigned long n, int &rn);
+
+// a divisor prepared by divInit() for repeated division, and freed
+// by divFree() (see BigIntDiv.cpp)
+struct DivInverse {
+	limb *d; // the divisor shifted so its top bit is set, n limbs
+	int n;
+	int shift; // bits d was shifted by
+	limb v; // reciprocal(d[n - 1])
+	limb *mu; // floor(2^(128 n) / d), n + 1 limbs (long divisors only)
+};
+
+// set up division by the normalized n-limb magnitude b (b > 0)
+void divInit(DivInverse &inv, const limb *b, int n);
+
+// free the constants
+void divFree(DivInverse &inv);
+
+// q = a / b, r = a % b for a >= b; writes an - n + 1 limbs of q and
+// n limbs of r, like divmod() (n == 1 included)
+void divmodPre(DivInverse const& inv, limb *q, limb *r, const limb *a, int an);
+
+// r = a % b for a >= b; writes n limbs
+void modPre(DivInverse const& inv, limb *r, const limb *a, int an);
+
+// constants for arithmetic modulo a fixed m, set up by modInit() and
+// freed by modFree() (see BigIntMod.cpp). Residues are n-limb arrays
+// in the reducer's working form: Montgomery form (a * 2^(64 n) mod m)
+// for odd m, normal form otherwise
+struct ModReducer {
+	limb *m; // the modulus, n limbs with the top one nonzero
+	int n;
+	bool montgomery; // Montgomery form (odd m) or Barrett reduction
+	limb minv; // -m^-1 mod 2^64 (Montgomery)
+	limb *mprime; // -m^-1 mod 2^(64 n), for large moduli (Montgomery)
+	limb *r2; // 2^(128 n) mod m, to enter Montgomery form
+	limb *mu; // floor(2^(128 n) / m), n + 1 limbs (Barrett)
+	limb *one; // 1 in working form
+};
+
+// set up reduction modulo the normalized n-limb magnitude m (m > 0)
+void modInit(ModReducer &red, const limb *m, int n);
+
+// free what modInit() allocated
+void modFree(ModReducer &red);
+
+// limbs of scratch the modular routines below need for an n-limb m
+int modScratch(int n);
+
+// r = a mod m in normal form, for any an-limb a
+void modReduce(ModReducer const& red, limb *r, const limb *a, int an);
+
+// r = a * b mod m for residues in working form (r may alias a or b;
+// a == b squares)
+void modMul(ModReducer const& red, limb *r, const limb *a, const limb *b, limb *tp);
+
+// r = a mod m in working form, for any an-limb a
+void modToForm(ModReducer const& red, limb *r, const limb *a, int an, limb *tp);
+
+// r = a residue in working form, converted back to normal form
+void modFromForm(ModReducer const& red, limb *r, const limb *a, limb *tp);
+
+// r = b^e mod m by sliding-window exponentiation, in normal form;
+// writes n limbs (b and e any magnitudes)
+void powMod(ModReducer const& red, limb *r, const limb *b, int bn, const limb *e, int en);
+
+// write the decimal digits of a normalized magnitude to s (no sign,
+// no terminator, no leading zeros) and return how many were written;
+// s needs room for 20 * an characters (see BigIntRadix.cpp)
+int toDecimal(char *s, const limb *a, int an);
+
+// parse len decimal digits (which the caller has validated) into a
+// new array from allocate(), storing its normalized length in rn
+limb *fromDecimal(const char *s, int len, int &rn);
+
+// parse len hexadecimal digits (either case, validated by the caller)
+// into a new array from allocate(), storing its normalized length in rn
+limb *fromHex(const char *s, int len, int &rn);
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+/****************************************************************
+ * BigIntMod.cpp -- modular reduction and exponentiation
+ ****************************************************************/
+#include <stddef.h>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * modular arithmetic
+ *
+ * A ModReducer holds everything needed to multiply residues modulo
+ * a fixed m without dividing. Odd moduli use Montgomery form: a
+ * residue a is held as a * R mod m with R = 2^(64 n), and a product
+ * is brought back into range by REDC, which divides by R instead of
+ * by m. Small moduli run REDC one limb at a time; larger ones use
+ * two multiplications by the precomputed -m^-1 mod R, so the work
+ * rides on the fast multiplication tiers. Even moduli have no
+ * inverse mod R, so they keep residues in normal form and reduce
+ * with Barrett's method, which trades the division for two
+ * multiplications by the precomputed reciprocal 2^(128 n) / m.
+ *
+ * powMod() raises to a power by left-to-right sliding windows: the
+ * odd powers of the base up to 2^k are tabulated, and each run of up
+ * to k exponent bits ending in a one costs a single multiplication
+ * on top of the squarings.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// modulus length (in limbs) at which REDC switches from the
+// limb-at-a-time loop to multiplications by -m^-1 mod R
+const int REDC_MUL_THRESHOLD = 300;
+
+// -m^-1 mod 2^64 for odd m, by Newton iteration
+static limb negInverseLimb(limb m) {
+	limb inv = m; // correct to 3 bits for any odd m
+	for (int i = 0; i < 5; i++) {
+		inv *= 2 - m * inv;
+	}
+	return (limb)0 - inv;
+}
+
+// r = t / R mod m for t < m * R, one limb at a time (t has 2n limbs
+// and is destroyed). Each step clears the lowest limb of t by adding
+// a multiple of m and parks the carry in the cleared limb; the
+// parked carries are added back in one pass at the end
+static void redcBasecase(limb *r, limb *t, const limb *m, int n, limb minv) {
+	for (int i = 0; i < n; i++) {
+		limb q = t[i] * minv;
+		t[i] = addmul1(t + i, m, n, q);
+	}
+	limb carry = add(r, t + n, n, t, n);
+	if (carry != 0 || cmp(r, n, m, n) >= 0) {
+		sub(r, r, n, m, n);
+	}
+}
+
+// r = t / R mod m for t < m * R, by adding the multiple q * m that
+// clears the low half of t, where q = t * (-m^-1) mod R. t has 2n
+// limbs and is destroyed; tp is scratch of 4n limbs
+static void redcMul(limb *r, limb *t, ModReducer const& red, limb *tp) {
+	int n = red.n;
+	limb *q = tp, *qm = tp + 2 * n;
+	mul(q, t, n, red.mprime, n);
+	mul(qm, q, n, red.m, n);
+	limb carry = add(t, t, 2 * n, qm, 2 * n);
+	copy(r, t + n, n);
+	if (carry != 0 || cmp(r, n, red.m, n) >= 0) {
+		sub(r, r, n, red.m, n);
+	}
+}
+
+// r = t mod m for t < m^2 by Barrett's method (t has 2n limbs); tp
+// is scratch of 4n + 4 limbs
+static void barrettReduce(limb *r, const limb *t, ModReducer const& red, limb *tp) {
+	int n = red.n;
+	// q = floor(floor(t / B^(n-1)) * mu / B^(n+1)) is at most two
+	// short of floor(t / m)
+	limb *q2 = tp, *qm = tp + 2 * n + 2;
+	mul(q2, red.mu, n + 1, t + n - 1, n + 1);
+	const limb *q = q2 + n + 1;
+	mul(qm, q, n + 1, red.m, n);
+
+	// rem = (t - q * m) mod B^(n+1) is then below 3m; the low limbs
+	// of q2 are free to hold it
+	limb *rem = q2;
+	sub(rem, t, n + 1, qm, n + 1);
+	while (rem[n] != 0 || cmp(rem, n, red.m, n) >= 0) {
+		rem[n] -= sub(rem, rem, n, red.m, n);
+	}
+	copy(r, rem, n);
+}
+
+// reduce the 2n-limb product t into r
+static void reduceProduct(limb *r, limb *t, ModReducer const& red, limb *tp) {
+	if (!red.montgomery) {
+		barrettReduce(r, t, red, tp);
+	}
+	else if (red.n < REDC_MUL_THRESHOLD) {
+		redcBasecase(r, t, red.m, red.n, red.minv);
+	}
+	else {
+		redcMul(r, t, red, tp);
+	}
+}
+
+// r = a mod m for any a, as n limbs
+void modReduce(ModReducer const& red, limb *r, const limb *a, int an) {
+	int n = red.n;
+	an = normalize(a, an);
+	if (an < n || (an == n && cmp(a, an, red.m, n) < 0)) {
+		copy(r, a, an);
+		zero(r + an, n - an);
+	}
+	else if (n == 1) {
+		r[0] = mod1(a, an, red.m[0]);
+	}
+	else {
+		limb *q = allocate(an - n + 1);
+		divmod(q, r, a, an, red.m, n);
+		release(q);
+	}
+}
+
+// set up the constants for reduction modulo m
+void modInit(ModReducer &red, const limb *m, int n) {
+	red.n = n;
+	red.m = allocate(n);
+	copy(red.m, m, n);
+	red.montgomery = (m[0] & 1) != 0;
+	red.minv = 0;
+	red.mprime = NULL;
+	red.r2 = NULL;
+	red.mu = NULL;
+	red.one = allocate(n);
+
+	// B^(2n), to be reduced or divided by m
+	limb *big = allocate(2 * n + 1);
+	zero(big, 2 * n);
+	big[2 * n] = 1;
+
+	if (red.montgomery) {
+		red.minv = negInverseLimb(m[0]);
+		red.r2 = allocate(n);
+		modReduce(red, red.r2, big, 2 * n + 1);
+		modReduce(red, red.one, big + n, n + 1); // R mod m
+
+		if (n >= REDC_MUL_THRESHOLD) {
+			// -m^-1 mod R digit by digit: each step picks the limb that
+			// clears the next limb of 1 + q * m
+			red.mprime = allocate(n);
+			limb *t = allocate(n);
+			zero(t, n);
+			t[0] = 1;
+			for (int i = 0; i < n; i++) {
+				limb q = t[i] * red.minv;
+				red.mprime[i] = q;
+				addmul1(t + i, m, n - i, q);
+			}
+			release(t);
+		}
+	}
+	else {
+		// mu = floor(B^(2n) / m), n + 1 limbs
+		red.mu = allocate(n + 2);
+		zero(red.mu, n + 2);
+		if (n == 1) {
+			divmod1(big, big, 2 * n + 1, m[0]);
+			copy(red.mu, big, n + 1);
+		}
+		else {
+			limb *r = allocate(n);
+			divmod(red.mu, r, big, 2 * n + 1, m, n);
+			release(r);
+		}
+		if (red.mu[n + 1] != 0) {
+			// m = B^(n-1) gives mu = B^(n+1); one less keeps it in n + 1
+			// limbs and costs at most one more correction
+			for (int i = 0; i <= n; i++) {
+				red.mu[i] = ~(limb)0;
+			}
+		}
+		zero(red.one, n);
+		red.one[0] = 1;
+	}
+	release(big);
+}
+
+// free the constants
+void modFree(ModReducer &red) {
+	release(red.m);
+	release(red.one);
+	if (red.mprime != NULL) release(red.mprime);
+	if (red.r2 != NULL) release(red.r2);
+	if (red.mu != NULL) release(red.mu);
+}
+
+// scratch needed by modMul and the conversions
+int modScratch(int n) {
+	return 6 * n + 4;
+}
+
+// product of two residues in working form
+void modMul(ModReducer const& red, limb *r, const limb *a, const limb *b, limb *tp) {
+	int n = red.n;
+	limb *t = tp;
+	if (a == b) {
+		sqr(t, a, n);
+	}
+	else {
+		mul(t, a, n, b, n);
+	}
+	reduceProduct(r, t, red, tp + 2 * n);
+}
+
+// any number into working form
+void modToForm(ModReducer const& red, limb *r, const limb *a, int an, limb *tp) {
+	modReduce(red, r, a, an);
+	if (red.montgomery) modMul(red, r, r, red.r2, tp);
+}
+
+// a residue in working form back to normal form
+void modFromForm(ModReducer const& red, limb *r, const limb *a, limb *tp) {
+	int n = red.n;
+	if (!red.montgomery) {
+		copy(r, a, n);
+		return;
+	}
+	limb *t = tp;
+	copy(t, a, n);
+	zero(t + n, n);
+	reduceProduct(r, t, red, tp + 2 * n);
+}
+
+// number of bits in a normalized magnitude
+static long bitLength(const limb *a, int an) {
+	return (long)(an - 1) * LIMB_BITS + (LIMB_BITS - __builtin_clzll(a[an - 1]));
+}
+
+// bit i of a
+static inline int bitAt(const limb *a, long i) {
+	return (int)((a[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1);
+}
+
+// r = b^e mod m by sliding windows
+void powMod(ModReducer const& red, limb *r, const limb *b, int bn, const limb *e, int en) {
+	int n = red.n;
+	limb *tp = allocate(modScratch(n));
+
+	en = normalize(e, en);
+	long bits = (en == 1 && e[0] == 0) ? 0 : bitLength(e, en);
+
+	// window width for this exponent size
+	int k = (bits <= 8) ? 1 : (bits <= 24) ? 2 : (bits <= 80) ? 3 : (bits <= 240) ? 4 : (bits <= 672) ? 5 : 6;
+
+	// odd powers b, b^3, ..., b^(2^k - 1) in working form
+	int tableSize = 1 << (k - 1);
+	limb *table = allocate(tableSize * n + n);
+	limb *b2 = table + tableSize * n;
+	modToForm(red, table, b, bn, tp);
+	if (tableSize > 1) {
+		modMul(red, b2, table, table, tp);
+		for (int i = 1; i < tableSize; i++) {
+			modMul(red, table + i * n, table + (i - 1) * n, b2, tp);
+		}
+	}
+
+	limb *x = allocate(n);
+	copy(x, red.one, n);
+	bool started = false;
+	long i = bits - 1;
+	while (i >= 0) {
+		if (bitAt(e, i) == 0) {
+			if (started) modMul(red, x, x, x, tp);
+			i--;
+			continue;
+		}
+
+		// the longest window of at most k bits from i down that ends
+		// in a one
+		long j = i - k + 1;
+		if (j < 0) j = 0;
+		while (bitAt(e, j) == 0) j++;
+		int w = 0;
+		for (long t = i; t >= j; t--) {
+			w = (w << 1) | bitAt(e, t);
+		}
+
+		const limb *power = table + (w >> 1) * n;
+		if (started) {
+			for (long t = i; t >= j; t--) {
+				modMul(red, x, x, x, tp);
+			}
+			modMul(red, x, x, power, tp);
+		}
+		else {
+			// the first window just loads its power
+			copy(x, power, n);
+			started = true;
+		}
+		i = j - 1;
+	}
+
+	modFromForm(red, r, x, tp);
+	release(x);
+	release(table);
+	release(tp);
+}
+
+}
@@ -0,0 +1,545 @@
+/****************************************************************
+ * BigIntMul.cpp -- size-dispatched multiplication for BigInt
+ ****************************************************************/
+#include <stddef.h>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * multiplication engine
+ *
+ * limbs::mul() picks an algorithm by the length of the shorter
+ * operand:
+ * - below KARATSUBA_THRESHOLD: schoolbook (mulBasecase)
+ * - below TOOM3_THRESHOLD: Karatsuba
+ * - below TOOM4_THRESHOLD: Toom-3
+ * - below NTT_THRESHOLD: Toom-4
+ * - otherwise: three-prime NTT (BigIntNtt.cpp)
+ * Very unbalanced products are cut into balanced blocks first, so
+ * the fast tiers also apply to e.g. a huge number times a medium
+ * one.
+ *
+ * limbs::sqr() runs the same tiers for a * a, with thresholds of
+ * its own. Each tier saves work by evaluating the operand only once
+ * and by squaring its sub-products; the basecase computes each
+ * cross product a[i] * a[j] once and doubles them all together.
+ *
+ * The sub-products of Karatsuba and Toom-Cook are independent, so
+ * from PARALLEL_MUL_THRESHOLD up they run as one batch of tasks,
+ * which the thread pool (BigIntThread.cpp) shares out when the
+ * calling thread may use more than one thread.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// operand lengths (in limbs) at which each tier takes over
+const int KARATSUBA_THRESHOLD = 32;
+const int TOOM3_THRESHOLD = 200;
+const int TOOM4_THRESHOLD = 600;
+const int NTT_THRESHOLD = 10000;
+
+// the same for squaring (the Toom tiers need at least 10 limbs so
+// that every piece is non-empty)
+const int SQR_KARATSUBA_THRESHOLD = 48;
+const int SQR_TOOM3_THRESHOLD = 200;
+const int SQR_TOOM4_THRESHOLD = 600;
+const int SQR_NTT_THRESHOLD = 10000;
+
+// shorter-operand length (in limbs) from which the sub-products of
+// the Karatsuba and Toom tiers may run in parallel
+const int PARALLEL_MUL_THRESHOLD = 2000;
+
+/*****************************************************************
+ * signed helper values for Toom-Cook
+ *
+ * Evaluating at negative points and interpolating produce signed
+ * intermediates, so these are kept as sign + magnitude. Buffers
+ * grow on demand and are reused, and the operations below run in
+ * place, so the target may alias an operand.
+ *****************************************************************/
+
+struct SignedLimbs {
+	limb *d; // magnitude (normalized)
+	int len; // length of magnitude in limbs
+	int cap; // allocated length of d
+	bool neg; // sign of the value
+
+	SignedLimbs() : d(NULL), len(0), cap(0), neg(false) {}
+
+	~SignedLimbs() {
+		if (d != NULL) release(d);
+	}
+
+	// make room for n limbs, keeping the current value
+	void reserve(int n) {
+		if (n <= cap) return;
+		limb *p = allocate(n);
+		if (d != NULL) {
+			copy(p, d, len);
+			release(d);
+		}
+		d = p;
+		cap = n;
+	}
+
+	// strip leading zeros after an operation wrote n limbs
+	void fix(int n) {
+		len = normalize(d, n);
+		if (len == 1 && d[0] == 0) neg = false;
+	}
+
+private:
+	SignedLimbs(SignedLimbs const&);
+	void operator=(SignedLimbs const&);
+};
+
+// r = the n-limb slice a
+static void setSlice(SignedLimbs &r, const limb *a, int n, bool neg) {
+	r.reserve(n);
+	copy(r.d, a, n);
+	r.neg = neg;
+	r.fix(n);
+}
+
+// r = a + b, or a - b if subtract is set
+static void addSigned(SignedLimbs &r, SignedLimbs const& a, SignedLimbs const& b, bool subtract) {
+	bool aNeg = a.neg, bNeg = (b.neg != subtract);
+	int aLen = a.len, bLen = b.len;
+	r.reserve(((aLen > bLen) ? aLen : bLen) + 1);
+	if (aNeg == bNeg) {
+		// same signs, so add magnitudes
+		if (aLen >= bLen) {
+			r.d[aLen] = add(r.d, a.d, aLen, b.d, bLen);
+		}
+		else {
+			r.d[bLen] = add(r.d, b.d, bLen, a.d, aLen);
+		}
+		r.neg = aNeg;
+		r.fix(((aLen > bLen) ? aLen : bLen) + 1);
+	}
+	else if (cmp(a.d, aLen, b.d, bLen) >= 0) {
+		// |a| wins, so the result takes the sign of a
+		sub(r.d, a.d, aLen, b.d, bLen);
+		r.neg = aNeg;
+		r.fix(aLen);
+	}
+	else {
+		// |b| wins, so the result takes the (effective) sign of b
+		sub(r.d, b.d, bLen, a.d, aLen);
+		r.neg = bNeg;
+		r.fix(bLen);
+	}
+}
+
+// r = a * m for a small signed m
+static void mulSmall(SignedLimbs &r, SignedLimbs const& a, long m) {
+	limb absM = (m < 0) ? (limb)0 - (limb)m : (limb)m;
+	bool neg = (a.neg != (m < 0));
+	int n = a.len;
+	r.reserve(n + 1);
+	r.d[n] = mul1(r.d, a.d, n, absM);
+	r.neg = neg;
+	r.fix(n + 1);
+}
+
+// r = a / m for a small signed m that is known to divide a exactly
+static void divExact(SignedLimbs &r, SignedLimbs const& a, long m) {
+	limb absM = (m < 0) ? (limb)0 - (limb)m : (limb)m;
+	bool neg = (a.neg != (m < 0));
+	int n = a.len;
+	r.reserve(n);
+	divexact1(r.d, a.d, n, absM);
+	r.neg = neg;
+	r.fix(n);
+}
+
+// r = a * b (r must not alias a or b); squares when a and b are
+// the same value
+static void mulSigned(SignedLimbs &r, SignedLimbs const& a, SignedLimbs const& b) {
+	r.reserve(a.len + b.len);
+	if (&a == &b) {
+		sqr(r.d, a.d, a.len);
+	}
+	else {
+		mul(r.d, a.d, a.len, b.d, b.len);
+	}
+	r.neg = (a.neg != b.neg);
+	r.fix(a.len + b.len);
+}
+
+// r = a * b, waiting in a batch
+struct MulJob {
+	limb *r;
+	const limb *a;
+	int an;
+	const limb *b;
+	int bn;
+};
+
+static void runMul(void *arg) {
+	MulJob *job = (MulJob *)arg;
+	mul(job->r, job->a, job->an, job->b, job->bn);
+}
+
+// the same for signed values
+struct SignedMulJob {
+	SignedLimbs *r;
+	SignedLimbs const *a;
+	SignedLimbs const *b;
+};
+
+static void runSignedMul(void *arg) {
+	SignedMulJob *job = (SignedMulJob *)arg;
+	mulSigned(*job->r, *job->a, *job->b);
+}
+
+// run count (at most 7) products whose shorter operands are about
+// size limbs, in parallel if they are big enough to pay for it
+static void runProducts(MulJob *jobs, int count, int size) {
+	if (size < PARALLEL_MUL_THRESHOLD || concurrency() <= 1) {
+		for (int i = 0; i < count; i++) {
+			runMul(&jobs[i]);
+		}
+		return;
+	}
+	Task tasks[7];
+	for (int i = 0; i < count; i++) {
+		tasks[i].run = runMul;
+		tasks[i].arg = &jobs[i];
+	}
+	runTasks(tasks, count);
+}
+
+static void runProducts(SignedMulJob *jobs, int count, int size) {
+	if (size < PARALLEL_MUL_THRESHOLD || concurrency() <= 1) {
+		for (int i = 0; i < count; i++) {
+			runSignedMul(&jobs[i]);
+		}
+		return;
+	}
+	Task tasks[7];
+	for (int i = 0; i < count; i++) {
+		tasks[i].run = runSignedMul;
+		tasks[i].arg = &jobs[i];
+	}
+	runTasks(tasks, count);
+}
+
+/*****************************************************************
+ * Karatsuba
+ *****************************************************************/
+
+// Karatsuba multiplication where an >= bn > ceil(an / 2)
+static void mulKaratsuba(limb *r, const limb *a, int an, const limb *b, int bn) {
+	// split both operands at h limbs: x = x0 + x1 * B^h
+	int h = (an + 1) / 2;
+	int a1n = an - h, b1n = bn - h;
+
+	// low and high products go straight into the result, the middle
+	// product (a0 + a1)(b0 + b1) - a0*b0 - a1*b1 into scratch
+	limb *sa = allocate(4 * h + 4);
+	limb *sb = sa + h + 1;
+	limb *mid = sb + h + 1;
+	sa[h] = add(sa, a, h, a + h, a1n);
+	sb[h] = add(sb, b, h, b + h, b1n);
+	MulJob jobs[3] = {
+		{r, a, h, b, h},
+		{r + 2 * h, a + h, a1n, b + h, b1n},
+		{mid, sa, h + 1, sb, h + 1}
+	};
+	runProducts(jobs, 3, bn);
+	subFrom(mid, 2 * h + 2, r, 2 * h);
+	subFrom(mid, 2 * h + 2, r + 2 * h, a1n + b1n);
+
+	// add the middle product in at B^h; it fits below the top limb
+	int rest = an + bn - h;
+	int midLen = normalize(mid, (2 * h + 2 < rest) ? 2 * h + 2 : rest);
+	addTo(r + h, rest, mid, midLen);
+	release(sa);
+}
+
+// Karatsuba squaring: (a0 + a1)^2 - a0^2 - a1^2 = 2 a0 a1
+static void sqrKaratsuba(limb *r, const limb *a, int n) {
+	int h = (n + 1) / 2;
+	int a1n = n - h;
+
+	limb *sa = allocate(3 * h + 3);
+	limb *mid = sa + h + 1;
+	sa[h] = add(sa, a, h, a + h, a1n);
+	MulJob jobs[3] = {
+		{r, a, h, a, h},
+		{r + 2 * h, a + h, a1n, a + h, a1n},
+		{mid, sa, h + 1, sa, h + 1}
+	};
+	runProducts(jobs, 3, n);
+	subFrom(mid, 2 * h + 2, r, 2 * h);
+	subFrom(mid, 2 * h + 2, r + 2 * h, 2 * a1n);
+
+	int rest = 2 * n - h;
+	int midLen = normalize(mid, (2 * h + 2 < rest) ? 2 * h + 2 : rest);
+	addTo(r + h, rest, mid, midLen);
+	release(sa);
+}
+
+/*****************************************************************
+ * Toom-Cook
+ *
+ * Toom-k splits each operand into k pieces, multiplies the two
+ * piece polynomials at 2k - 2 small integer points plus infinity,
+ * and recovers the product's 2k - 1 coefficients by interpolation.
+ * All divisions in the interpolation sequences are exact.
+ *****************************************************************/
+
+// load the k pieces of an n-limb operand split every s limbs
+static void splitPieces(SignedLimbs *p, const limb *a, int n, int s, int k) {
+	for (int i = 0; i < k; i++) {
+		int len = (i < k - 1) ? s : n - (k - 1) * s;
+		setSlice(p[i], a + i * s, len, false);
+	}
+}
+
+// r = sum of c[i] * B^(i*s); every coefficient is non-negative
+static void recompose(limb *r, int rn, SignedLimbs *c, int count, int s) {
+	zero(r, rn);
+	for (int i = 0; i < count; i++) {
+		int offset = i * s;
+		int len = (c[i].len < rn - offset) ? c[i].len : rn - offset;
+		addTo(r + offset, rn - offset, c[i].d, normalize(c[i].d, len));
+	}
+}
+
+// Toom-3 evaluation at 1, -1 and -2
+static void evalToom3(SignedLimbs *p, SignedLimbs &e1, SignedLimbs &em1, SignedLimbs &em2) {
+	addSigned(em2, p[0], p[2], false); // a0 + a2
+	addSigned(e1, em2, p[1], false);
+	addSigned(em1, em2, p[1], true);
+	addSigned(em2, em1, p[2], false); // ((a0 - a1 + a2) + a2) * 2 - a0
+	mulSmall(em2, em2, 2);
+	addSigned(em2, em2, p[0], true);
+}
+
+// Toom-3 multiplication where an >= bn > 2 * ceil(an / 3), using
+// the points 0, 1, -1, -2 and infinity (Bodrato's sequence). When
+// a and b are the same operand it is evaluated once and the
+// pointwise products are squares
+static void mulToom3(limb *r, const limb *a, int an, const limb *b, int bn) {
+	int s = (an + 2) / 3;
+	bool square = (a == b && an == bn);
+	SignedLimbs pa[3], pb[3], ea[3], eb[3];
+	splitPieces(pa, a, an, s, 3);
+	evalToom3(pa, ea[0], ea[1], ea[2]);
+	SignedLimbs *qb = pa, *fb = ea;
+	if (!square) {
+		splitPieces(pb, b, bn, s, 3);
+		evalToom3(pb, eb[0], eb[1], eb[2]);
+		qb = pb;
+		fb = eb;
+	}
+
+	// pointwise products; c[] ends up holding the coefficients
+	SignedLimbs c[5], vm2;
+	SignedMulJob jobs[5] = {
+		{&c[0], &pa[0], &qb[0]},
+		{&c[1], &ea[0], &fb[0]},
+		{&c[2], &ea[1], &fb[1]},
+		{&vm2, &ea[2], &fb[2]},
+		{&c[4], &pa[2], &qb[2]}
+	};
+	runProducts(jobs, 5, bn);
+
+	// c[3] = (v(-2) - v(1)) / 3
+	addSigned(c[3], vm2, c[1], true);
+	divExact(c[3], c[3], 3);
+	// c[1] = (v(1) - v(-1)) / 2
+	addSigned(c[1], c[1], c[2], true);
+	divExact(c[1], c[1], 2);
+	// c[2] = v(-1) - v(0)
+	addSigned(c[2], c[2], c[0], true);
+	// c[3] = (c[2] - c[3]) / 2 + 2 * v(inf)
+	addSigned(c[3], c[2], c[3], true);
+	divExact(c[3], c[3], 2);
+	mulSmall(vm2, c[4], 2);
+	addSigned(c[3], c[3], vm2, false);
+	// c[2] = c[2] + c[1] - v(inf)
+	addSigned(c[2], c[2], c[1], false);
+	addSigned(c[2], c[2], c[4], true);
+	// c[1] = c[1] - c[3]
+	addSigned(c[1], c[1], c[3], true);
+
+	recompose(r, an + bn, c, 5, s);
+}
+
+// Toom-4 evaluation at 1, -1, 2, -2 and 3
+static void evalToom4(SignedLimbs *p, SignedLimbs *e, SignedLimbs &t) {
+	// even and odd parts at 1
+	addSigned(e[0], p[0], p[2], false);
+	addSigned(t, p[1], p[3], false);
+	addSigned(e[1], e[0], t, true);
+	addSigned(e[0], e[0], t, false);
+	// even and odd parts at 2: (a0 + 4 a2) and (2 a1 + 8 a3)
+	mulSmall(e[2], p[2], 4);
+	addSigned(e[2], e[2], p[0], false);
+	mulSmall(t, p[3], 4);
+	addSigned(t, t, p[1], false);
+	mulSmall(t, t, 2);
+	addSigned(e[3], e[2], t, true);
+	addSigned(e[2], e[2], t, false);
+	// Horner's rule at 3
+	mulSmall(e[4], p[3], 3);
+	addSigned(e[4], e[4], p[2], false);
+	mulSmall(e[4], e[4], 3);
+	addSigned(e[4], e[4], p[1], false);
+	mulSmall(e[4], e[4], 3);
+	addSigned(e[4], e[4], p[0], false);
+}
+
+// Toom-4 multiplication where an >= bn > 3 * ceil(an / 4), using
+// the points 0, 1, -1, 2, -2, 3 and infinity. The even and odd
+// coefficients are separated with the symmetric point pairs and
+// solved for independently. Squares evaluate only once, as in
+// Toom-3
+static void mulToom4(limb *r, const limb *a, int an, const limb *b, int bn) {
+	int s = (an + 3) / 4;
+	bool square = (a == b && an == bn);
+	SignedLimbs pa[4], pb[4], ea[5], eb[5], t;
+	splitPieces(pa, a, an, s, 4);
+	evalToom4(pa, ea, t);
+	SignedLimbs *qb = pa, *fb = ea;
+	if (!square) {
+		splitPieces(pb, b, bn, s, 4);
+		evalToom4(pb, eb, t);
+		qb = pb;
+		fb = eb;
+	}
+
+	// pointwise products v(1), v(-1), v(2), v(-2), v(3)
+	SignedLimbs c[7], v[5];
+	SignedMulJob jobs[7];
+	for (int j = 0; j < 5; j++) {
+		SignedMulJob job = {&v[j], &ea[j], &fb[j]};
+		jobs[j] = job;
+	}
+	SignedMulJob low = {&c[0], &pa[0], &qb[0]}, high = {&c[6], &pa[3], &qb[3]};
+	jobs[5] = low;
+	jobs[6] = high;
+	runProducts(jobs, 7, bn);
+
+	// c1 + c3 + c5 and c1 + 4 c3 + 16 c5 from the odd parts
+	addSigned(c[1], v[0], v[1], true);
+	divExact(c[1], c[1], 2);
+	addSigned(c[3], v[2], v[3], true);
+	divExact(c[3], c[3], 4);
+	// c2 + c4 and c2 + 4 c4 from the even parts
+	addSigned(c[2], v[0], v[1], false);
+	divExact(c[2], c[2], 2);
+	addSigned(c[2], c[2], c[0], true);
+	addSigned(c[2], c[2], c[6], true);
+	addSigned(c[4], v[2], v[3], false);
+	divExact(c[4], c[4], 2);
+	addSigned(c[4], c[4], c[0], true);
+	mulSmall(t, c[6], 64);
+	addSigned(c[4], c[4], t, true);
+	divExact(c[4], c[4], 4);
+	// solve for c4 then c2
+	addSigned(c[4], c[4], c[2], true);
+	divExact(c[4], c[4], 3);
+	addSigned(c[2], c[2], c[4], true);
+
+	// c1 + 9 c3 + 81 c5 from v(3) with the even terms removed
+	addSigned(c[5], v[4], c[0], true);
+	mulSmall(t, c[2], 9);
+	addSigned(c[5], c[5], t, true);
+	mulSmall(t, c[4], 81);
+	addSigned(c[5], c[5], t, true);
+	mulSmall(t, c[6], 729);
+	addSigned(c[5], c[5], t, true);
+	divExact(c[5], c[5], 3);
+	// f2 = (that - (c1 + 4 c3 + 16 c5)) / 5 = c3 + 13 c5
+	addSigned(c[5], c[5], c[3], true);
+	divExact(c[5], c[5], 5);
+	// f1 = ((c1 + 4 c3 + 16 c5) - (c1 + c3 + c5)) / 3 = c3 + 5 c5
+	addSigned(c[3], c[3], c[1], true);
+	divExact(c[3], c[3], 3);
+	// c5 = (f2 - f1) / 8, c3 = f1 - 5 c5, c1 = (c1 + c3 + c5) - c3 - c5
+	addSigned(c[5], c[5], c[3], true);
+	divExact(c[5], c[5], 8);
+	mulSmall(t, c[5], 5);
+	addSigned(c[3], c[3], t, true);
+	addSigned(c[1], c[1], c[3], true);
+	addSigned(c[1], c[1], c[5], true);
+
+	recompose(r, an + bn, c, 7, s);
+}
+
+/*****************************************************************
+ * dispatch
+ *****************************************************************/
+
+// multiply a long operand by a much shorter one in balanced blocks
+static void mulUnbalanced(limb *r, const limb *a, int an, const limb *b, int bn) {
+	// the first block initializes the result, the rest accumulate
+	mul(r, a, bn, b, bn);
+	zero(r + 2 * bn, an - bn);
+	limb *temp = allocate(2 * bn);
+	for (int offset = bn; offset < an; offset += bn) {
+		int len = (an - offset < bn) ? an - offset : bn;
+		mul(temp, a + offset, len, b, bn);
+		addTo(r + offset, an + bn - offset, temp, len + bn);
+	}
+	release(temp);
+}
+
+// size-dispatched multiplication
+void mul(limb *r, const limb *a, int an, const limb *b, int bn) {
+	// a product of an operand with itself is a square
+	if (a == b && an == bn) {
+		sqr(r, a, an);
+		return;
+	}
+
+	// keep the longer operand first
+	if (an < bn) {
+		const limb *tp = a; a = b; b = tp;
+		int tn = an; an = bn; bn = tn;
+	}
+
+	if (bn < KARATSUBA_THRESHOLD) {
+		mulBasecase(r, a, an, b, bn);
+	}
+	else if (bn >= NTT_THRESHOLD) {
+		mulNtt(r, a, an, b, bn);
+	}
+	else if (bn <= (an + 1) / 2) {
+		mulUnbalanced(r, a, an, b, bn);
+	}
+	else if (bn >= TOOM4_THRESHOLD && bn > 3 * ((an + 3) / 4)) {
+		mulToom4(r, a, an, b, bn);
+	}
+	else if (bn >= TOOM3_THRESHOLD && bn > 2 * ((an + 2) / 3)) {
+		mulToom3(r, a, an, b, bn);
+	}
+	else {
+		mulKaratsuba(r, a, an, b, bn);
+	}
+}
+
+// size-dispatched squaring
+void sqr(limb *r, const limb *a, int n) {
+	if (n < SQR_KARATSUBA_THRESHOLD) {
+		sqrBasecase(r, a, n);
+	}
+	else if (n >= SQR_NTT_THRESHOLD) {
+		mulNtt(r, a, n, a, n);
+	}
+	else if (n >= SQR_TOOM4_THRESHOLD) {
+		mulToom4(r, a, n, a, n);
+	}
+	else if (n >= SQR_TOOM3_THRESHOLD) {
+		mulToom3(r, a, n, a, n);
+	}
+	else {
+		sqrKaratsuba(r, a, n);
+	}
+}
+
+}
@@ -0,0 +1,487 @@
+/****************************************************************
+ * BigIntNtt.cpp -- number-theoretic-transform multiplication
+ ****************************************************************/
+#include <stddef.h>
+#include <atomic>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * NTT multiplication
+ *
+ * Each limb is treated as one coefficient of a polynomial, and the
+ * product polynomial is computed by a cyclic convolution modulo
+ * three primes just below 2^62. Each coefficient of the product is
+ * below n * 2^128, far less than the product of the primes, so the
+ * exact coefficients are recovered by CRT (Garner's algorithm) and
+ * carried into the result. All arithmetic is exact integer
+ * arithmetic; there is no floating point rounding to worry about.
+ *
+ * Residues are kept in Montgomery form (x * 2^64 mod p) and are
+ * only reduced lazily into [0, 2p) inside the transforms, which is
+ * safe because 4p < 2^64. The forward transform is decimation-in-
+ * frequency and the inverse is decimation-in-time, so no bit-
+ * reversal pass is needed. Twiddle factors are cached per prime and
+ * laid out so each transform stage reads them contiguously.
+ *
+ * The three convolutions are independent, and so are the blocks of
+ * a transform once the stages above them are done, and the CRT of
+ * each coefficient; when the calling thread may use more than one
+ * thread, all of these run as parallel tasks (see BigIntThread.cpp).
+ * The twiddle cache is shared by all threads: a table is published
+ * atomically once complete, and a table outgrown by a longer
+ * transform is kept, as another thread may still be reading it.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// transform length from which the butterflies are split into
+// parallel tasks, and the shortest block a task is given
+const int NTT_PARALLEL_LENGTH = 1 << 16;
+const int NTT_PARALLEL_BLOCK = 1 << 12;
+
+// one NTT-friendly prime p = c * 2^k + 1 and its Montgomery constants
+struct NttPrime {
+	limb p; // the prime
+	limb pinv; // -p^-1 mod 2^64
+	limb r2; // 2^128 mod p
+	limb g; // a primitive root mod p
+
+	NttPrime(limb pIn, limb gIn) : p(pIn), g(gIn) {
+		// inverse of p mod 2^64 by Newton iteration
+		limb inv = p;
+		for (int i = 0; i < 5; i++) {
+			inv *= 2 - p * inv;
+		}
+		pinv = (limb)0 - inv;
+		dlimb r = ((dlimb)1 << 64) % p;
+		r2 = (limb)((r * r) % p);
+	}
+
+	// Montgomery reduction of t < p * 2^64, giving t / 2^64 mod p
+	// in [0, 2p)
+	inline limb reduceLazy(dlimb t) const {
+		limb m = (limb)t * pinv;
+		return (limb)((t + (dlimb)m * p) >> 64);
+	}
+
+	// Montgomery reduction into [0, p)
+	inline limb reduce(dlimb t) const {
+		limb u = reduceLazy(t);
+		return (u >= p) ? u - p : u;
+	}
+
+	inline limb mul(limb a, limb b) const {
+		return reduce((dlimb)a * b);
+	}
+
+	// product of values below 2p, left in [0, 2p)
+	inline limb mulLazy(limb a, limb b) const {
+		return reduceLazy((dlimb)a * b);
+	}
+
+	inline limb add(limb a, limb b) const {
+		limb s = a + b;
+		return (s >= p) ? s - p : s;
+	}
+
+	inline limb sub(limb a, limb b) const {
+		return (a >= b) ? a - b : a + p - b;
+	}
+
+	// convert any 64-bit value into Montgomery form
+	inline limb toMont(limb a) const {
+		return reduce((dlimb)a * r2);
+	}
+
+	// base^e for base in Montgomery form
+	limb pow(limb base, limb e) const {
+		limb result = toMont(1);
+		while (e > 0) {
+			if (e & 1) result = mul(result, base);
+			base = mul(base, base);
+			e >>= 1;
+		}
+		return result;
+	}
+};
+
+static const NttPrime &nttPrime(int k) {
+	static const NttPrime primes[3] = {
+		NttPrime(4179340454199820289ULL, 3), // 29 * 2^57 + 1
+		NttPrime(2485986994308513793ULL, 5), // 69 * 2^55 + 1
+		NttPrime(2936346957045563393ULL, 3) // 163 * 2^54 + 1
+	};
+	return primes[k];
+}
+
+// twiddle table for transforms of up to len points: the factors
+// w_m^j (j < m / 2) of the stage with m-point blocks live at
+// table[m / 2 + j], in Montgomery form
+struct NttTwiddles {
+	limb *forward;
+	limb *inverse;
+	int len; // largest transform length the tables cover
+	NttTwiddles *previous; // the outgrown table this one replaced
+};
+
+// twiddle tables for prime k covering transforms of len points
+static NttTwiddles const& nttTwiddles(int k, int len) {
+	static std::atomic<NttTwiddles *> cache[3];
+	NttTwiddles *current = cache[k].load(std::memory_order_acquire);
+	if (current != NULL && current->len >= len) return *current;
+
+	NttPrime const& P = nttPrime(k);
+	NttTwiddles *t = new NttTwiddles;
+	t->forward = allocateHeap(len);
+	t->inverse = allocateHeap(len);
+	t->len = len;
+
+	// powers of the primitive len-th root and its inverse fill the
+	// largest stage; every smaller stage takes a stride of them
+	limb w = P.pow(P.toMont(P.g), (P.p - 1) / len);
+	limb wInv = P.pow(w, len - 1);
+	limb *fwd = t->forward + len / 2, *inv = t->inverse + len / 2;
+	fwd[0] = inv[0] = P.toMont(1);
+	for (int j = 1; j < len / 2; j++) {
+		fwd[j] = P.mul(fwd[j - 1], w);
+		inv[j] = P.mul(inv[j - 1], wInv);
+	}
+	for (int m = len / 2; m >= 2; m >>= 1) {
+		for (int j = 0; j < m / 2; j++) {
+			t->forward[m / 2 + j] = fwd[j * (len / m)];
+			t->inverse[m / 2 + j] = inv[j * (len / m)];
+		}
+	}
+
+	// publish the table, unless another thread has meanwhile put up
+	// one that is long enough
+	t->previous = current;
+	while (!cache[k].compare_exchange_weak(current, t, std::memory_order_acq_rel, std::memory_order_acquire)) {
+		if (current != NULL && current->len >= len) {
+			release(t->forward);
+			release(t->inverse);
+			delete t;
+			return *current;
+		}
+		t->previous = current;
+	}
+	return *t;
+}
+
+// butterflies j in [from, to) of one forward block split into x and
+// y = x + half
+static inline void forwardButterflies(NttPrime const& P, limb *x, limb *y, const limb *w, int from, int to) {
+	limb p2 = 2 * P.p;
+	for (int j = from; j < to; j++) {
+		limb u = x[j], v = y[j];
+		limb s = u + v;
+		x[j] = (s >= p2) ? s - p2 : s;
+		y[j] = P.mulLazy(u - v + p2, w[j]);
+	}
+}
+
+// the same for an inverse block
+static inline void inverseButterflies(NttPrime const& P, limb *x, limb *y, const limb *w, int from, int to) {
+	limb p2 = 2 * P.p;
+	for (int j = from; j < to; j++) {
+		limb u = x[j], v = P.mulLazy(y[j], w[j]);
+		limb s = u + v, d = u - v + p2;
+		x[j] = (s >= p2) ? s - p2 : s;
+		y[j] = (d >= p2) ? d - p2 : d;
+	}
+}
+
+// forward transform (natural order in, bit-reversed order out);
+// values stay in [0, 2p)
+static void nttForward(NttPrime const& P, limb *a, int len, const limb *table) {
+	for (int m = len; m >= 2; m >>= 1) {
+		int half = m / 2;
+		for (int i = 0; i < len; i += m) {
+			forwardButterflies(P, a + i, a + i + half, table + half, 0, half);
+		}
+	}
+}
+
+// inverse transform without the 1/len scaling (bit-reversed order
+// in, natural order out); values stay in [0, 2p)
+static void nttInverse(NttPrime const& P, limb *a, int len, const limb *table) {
+	for (int m = 2; m <= len; m <<= 1) {
+		int half = m / 2;
+		for (int i = 0; i < len; i += m) {
+			inverseButterflies(P, a + i, a + i + half, table + half, 0, half);
+		}
+	}
+}
+
+// a share of a transform for one task: either the butterflies
+// [from, to) (counted across all blocks) of the stage with m-point
+// blocks, or, when m is 0, the whole transform of the len points
+// at a
+struct NttJob {
+	NttPrime const *P;
+	limb *a;
+	int len;
+	const limb *table;
+	bool inverse;
+	int m;
+	int from, to;
+};
+
+static void runNtt(void *arg) {
+	NttJob *job = (NttJob *)arg;
+	NttPrime const& P = *job->P;
+	if (job->m == 0) {
+		if (job->inverse) {
+			nttInverse(P, job->a, job->len, job->table);
+		}
+		else {
+			nttForward(P, job->a, job->len, job->table);
+		}
+		return;
+	}
+
+	int half = job->m / 2;
+	const limb *w = job->table + half;
+	for (int t = job->from; t < job->to; ) {
+		// butterfly t is number j of block t / half
+		limb *x = job->a + (t / half) * job->m;
+		int j = t % half;
+		int end = (half - j < job->to - t) ? half : j + (job->to - t);
+		if (job->inverse) {
+			inverseButterflies(P, x, x + half, w, j, end);
+		}
+		else {
+			forwardButterflies(P, x, x + half, w, j, end);
+		}
+		t += end - j;
+	}
+}
+
+// run one stage (m > 0) or the blocks of length len / parts (m = 0)
+// as parts tasks
+static void nttSplit(NttPrime const& P, limb *a, int len, const limb *table, bool inverse, int m, int parts) {
+	NttJob jobs[64];
+	Task tasks[64];
+	for (int i = 0; i < parts; i++) {
+		NttJob job = {&P, a, len, table, inverse, m, 0, 0};
+		if (m == 0) {
+			job.a = a + i * (len / parts);
+			job.len = len / parts;
+		}
+		else {
+			job.from = (int)((long)(len / 2) * i / parts);
+			job.to = (int)((long)(len / 2) * (i + 1) / parts);
+		}
+		jobs[i] = job;
+		tasks[i].run = runNtt;
+		tasks[i].arg = &jobs[i];
+	}
+	runTasks(tasks, parts);
+}
+
+// a transform in either direction, shared out between parts tasks
+// (a power of two): the stages above blocks of len / parts points
+// have their butterflies split evenly, and below that each task
+// transforms whole blocks
+static void nttTransform(NttPrime const& P, limb *a, int len, const limb *table, bool inverse) {
+	int threads = concurrency();
+	int parts = 1;
+	if (len >= NTT_PARALLEL_LENGTH) {
+		while (parts * 2 <= threads && parts < 64 && len / (parts * 2) >= NTT_PARALLEL_BLOCK) {
+			parts *= 2;
+		}
+	}
+	if (parts == 1) {
+		if (inverse) {
+			nttInverse(P, a, len, table);
+		}
+		else {
+			nttForward(P, a, len, table);
+		}
+		return;
+	}
+
+	if (inverse) {
+		nttSplit(P, a, len, table, true, 0, parts);
+		for (int m = 2 * (len / parts); m <= len; m <<= 1) {
+			nttSplit(P, a, len, table, true, m, parts);
+		}
+	}
+	else {
+		for (int m = len; m > len / parts; m >>= 1) {
+			nttSplit(P, a, len, table, false, m, parts);
+		}
+		nttSplit(P, a, len, table, false, 0, parts);
+	}
+}
+
+// convolution of a and b modulo prime k; leaves the len residues of
+// the product (in normal form, [0, p)) in fa. fb is scratch
+static void nttConvolve(int k, limb *fa, limb *fb, int len, const limb *a, int an, const limb *b, int bn) {
+	NttPrime const& P = nttPrime(k);
+	NttTwiddles const& tw = nttTwiddles(k, len);
+
+	if (a == b && an == bn) {
+		// squaring: one forward transform, and the 1/len scaling (in
+		// normal form, so the products leave Montgomery form) goes into
+		// the pointwise step instead
+		limb lenInv = P.reduce(P.pow(P.toMont(len), P.p - 2));
+		for (int i = 0; i < len; i++) {
+			fa[i] = (i < an) ? P.toMont(a[i]) : 0;
+		}
+		nttTransform(P, fa, len, tw.forward, false);
+		for (int i = 0; i < len; i++) {
+			fa[i] = P.mul(P.mulLazy(fa[i], fa[i]), lenInv);
+		}
+		nttTransform(P, fa, len, tw.inverse, true);
+		for (int i = 0; i < len; i++) {
+			if (fa[i] >= P.p) fa[i] -= P.p;
+		}
+		return;
+	}
+
+	// a is loaded in Montgomery form; b is loaded pre-scaled by 1/len
+	// in normal form, so the pointwise products come out as normal
+	// residues of a * b / len and the inverse transform needs no
+	// separate scaling pass
+	limb lenInv = P.pow(P.toMont(len), P.p - 2);
+	for (int i = 0; i < len; i++) {
+		fa[i] = (i < an) ? P.toMont(a[i]) : 0;
+		fb[i] = (i < bn) ? P.mul(b[i], lenInv) : 0;
+	}
+
+	nttTransform(P, fa, len, tw.forward, false);
+	nttTransform(P, fb, len, tw.forward, false);
+	for (int i = 0; i < len; i++) {
+		fa[i] = P.mulLazy(fa[i], fb[i]);
+	}
+	nttTransform(P, fa, len, tw.inverse, true);
+
+	for (int i = 0; i < len; i++) {
+		if (fa[i] >= P.p) fa[i] -= P.p;
+	}
+}
+
+// one convolution as a task
+struct ConvolveJob {
+	int k;
+	limb *fa, *fb;
+	int len;
+	const limb *a;
+	int an;
+	const limb *b;
+	int bn;
+};
+
+static void runConvolve(void *arg) {
+	ConvolveJob *job = (ConvolveJob *)arg;
+	nttConvolve(job->k, job->fa, job->fb, job->len, job->a, job->an, job->b, job->bn);
+}
+
+// Garner's algorithm for the coefficients [from, to): the residues
+// res[0..2][i] are replaced by the digits t0, t1, t2 of
+// x = t0 + p0 * (t1 + p1 * t2)
+struct GarnerJob {
+	limb **res;
+	int from, to;
+};
+
+static void runGarner(void *arg) {
+	GarnerJob *job = (GarnerJob *)arg;
+	NttPrime const& P0 = nttPrime(0);
+	NttPrime const& P1 = nttPrime(1);
+	NttPrime const& P2 = nttPrime(2);
+	// p0^-1 mod p1, (p0 p1)^-1 mod p2 and p0 mod p2, all scaled by
+	// 2^64 so that one Montgomery multiply applies them
+	limb p0Mod1 = P0.p - P1.p; // p0 < 2 * p1
+	limb c1 = P1.pow(P1.toMont(p0Mod1), P1.p - 2);
+	limb p0Mod2 = P0.p - P2.p; // p0 < 2 * p2
+	limb p1Mod2 = P1.p; // p1 < p2
+	limb c2 = P2.pow(P2.mul(P2.toMont(p0Mod2), P2.toMont(p1Mod2)), P2.p - 2);
+	limb p0Mont2 = P2.toMont(p0Mod2);
+
+	limb *res0 = job->res[0], *res1 = job->res[1], *res2 = job->res[2];
+	for (int i = job->from; i < job->to; i++) {
+		limb t0 = res0[i];
+		// t1 = (r1 - t0) / p0 mod p1
+		limb t0Mod1 = (t0 >= P1.p) ? t0 - P1.p : t0;
+		limb t1 = P1.mul(P1.sub(res1[i], t0Mod1), c1);
+		// t2 = (r2 - t0 - p0 * t1) / (p0 p1) mod p2
+		limb t0Mod2 = (t0 >= P2.p) ? t0 - P2.p : t0;
+		limb t1Mod2 = (t1 >= P2.p) ? t1 - P2.p : t1;
+		limb u = P2.add(t0Mod2, P2.mul(t1Mod2, p0Mont2));
+		res1[i] = t1;
+		res2[i] = P2.mul(P2.sub(res2[i], u), c2);
+	}
+}
+
+// NTT multiplication
+void mulNtt(limb *r, const limb *a, int an, const limb *b, int bn) {
+	int rn = an + bn;
+	int len = 1;
+	while (len < rn - 1) len <<= 1;
+
+	// the three convolutions share one scratch array unless they may
+	// run at the same time
+	int threads = concurrency();
+	limb *res[3], *scratch[3];
+	ConvolveJob convolve[3];
+	Task tasks[64];
+	for (int k = 0; k < 3; k++) {
+		res[k] = allocate(len);
+		scratch[k] = (k == 0 || threads > 1) ? allocate(len) : scratch[0];
+		ConvolveJob job = {k, res[k], scratch[k], len, a, an, b, bn};
+		convolve[k] = job;
+		tasks[k].run = runConvolve;
+		tasks[k].arg = &convolve[k];
+	}
+	runTasks(tasks, 3);
+	for (int k = 0; k < 3; k++) {
+		if (k == 0 || threads > 1) release(scratch[k]);
+	}
+
+	// CRT digits of the coefficients, in ranges for parallel tasks
+	int used = (rn < len) ? rn : len;
+	int parts = (used >= NTT_PARALLEL_LENGTH && threads > 1) ? ((threads < 64) ? threads : 64) : 1;
+	GarnerJob garner[64];
+	for (int i = 0; i < parts; i++) {
+		GarnerJob job = {res, (int)((long)used * i / parts), (int)((long)used * (i + 1) / parts)};
+		garner[i] = job;
+		tasks[i].run = runGarner;
+		tasks[i].arg = &garner[i];
+	}
+	runTasks(tasks, parts);
+
+	// recombine each coefficient and carry it into the result
+	NttPrime const& P0 = nttPrime(0);
+	NttPrime const& P1 = nttPrime(1);
+	dlimb p01 = (dlimb)P0.p * P1.p;
+	limb acc0 = 0, acc1 = 0, acc2 = 0;
+	for (int i = 0; i < rn; i++) {
+		limb t0 = 0, t1 = 0, t2 = 0;
+		if (i < used) {
+			t0 = res[0][i];
+			t1 = res[1][i];
+			t2 = res[2][i];
+		}
+
+		// add x = (t0 + p0 * t1) + p0 p1 * t2 into the 3-limb accumulator
+		dlimb low = (dlimb)P0.p * t1 + t0;
+		dlimb m1 = (dlimb)(limb)p01 * t2;
+		dlimb m2 = (dlimb)(limb)(p01 >> 64) * t2;
+		dlimb s = (dlimb)(limb)m1 + (limb)low + acc0;
+		r[i] = (limb)s;
+		s = (s >> 64) + (limb)(m1 >> 64) + (limb)m2 + (limb)(low >> 64) + acc1;
+		acc0 = (limb)s;
+		s = (s >> 64) + (limb)(m2 >> 64) + acc2;
+		acc1 = (limb)s;
+		acc2 = (limb)(s >> 64);
+	}
+
+	for (int k = 0; k < 3; k++) {
+		release(res[k]);
+	}
+}
+
+}
@@ -0,0 +1,215 @@
+/****************************************************************
+ * BigIntRadix.cpp -- decimal conversion for BigInt
+ ****************************************************************/
+#include <stddef.h>
+#include <atomic>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * radix conversion
+ *
+ * Small numbers are converted 19 decimal digits (one "chunk",
+ * the largest power of 10 that fits in a limb) at a time, which is
+ * quadratic. Larger numbers are split recursively around the
+ * cached powers 10^(19 * 2^k): printing divides by the power and
+ * converts the quotient and remainder separately, and parsing
+ * converts the two halves of the string and recombines them with
+ * one multiplication. Both then cost a small multiple of a
+ * multiplication or division of the full size.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// magnitude length (in limbs) at which the recursion takes over
+const int RADIX_DC_THRESHOLD = 30;
+
+const int CHUNK_DIGITS = 19;
+const limb CHUNK_BASE = 10000000000000000000ULL; // 10^19
+
+// 10^(19 * 2^k), computed by repeated squaring on first use and
+// cached for the life of the program. Each entry is published
+// atomically with its length in the limb before the power, so
+// threads converting at once share the cache; if two compute the
+// same power, one copy is kept and the other freed
+static const limb *decimalPower(int k, int &len) {
+	static std::atomic<limb *> powers[32];
+	limb *entry = powers[k].load(std::memory_order_acquire);
+	if (entry == NULL) {
+		limb *p;
+		if (k == 0) {
+			p = allocateHeap(2);
+			p[0] = 1;
+			p[1] = CHUNK_BASE;
+		}
+		else {
+			int prevLen;
+			const limb *prev = decimalPower(k - 1, prevLen);
+			p = allocateHeap(2 * prevLen + 1);
+			mul(p + 1, prev, prevLen, prev, prevLen);
+			p[0] = (limb)normalize(p + 1, 2 * prevLen);
+		}
+		if (powers[k].compare_exchange_strong(entry, p, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			entry = p;
+		}
+		else {
+			release(p);
+		}
+	}
+	len = (int)entry[0];
+	return entry + 1;
+}
+
+// write the 19 digits of one chunk, zero padded
+static void chunkToDecimal(char *s, limb chunk) {
+	for (int i = CHUNK_DIGITS - 1; i >= 0; i--) {
+		s[i] = (char)('0' + chunk % 10);
+		chunk /= 10;
+	}
+}
+
+// write a < 10^(19 * 2^k) as exactly 19 * 2^k digits, zero padded
+static void toDecimalRec(char *s, const limb *a, int an, int k) {
+	int width = CHUNK_DIGITS << k;
+
+	if (an < RADIX_DC_THRESHOLD || k <= 1) {
+		// peel chunks off the low end of a scratch copy
+		limb *scratch = allocate(an);
+		copy(scratch, a, an);
+		int len = an;
+		for (int pos = width - CHUNK_DIGITS; pos >= 0; pos -= CHUNK_DIGITS) {
+			limb chunk = 0;
+			if (len > 1 || scratch[0] != 0) {
+				chunk = divmod1(scratch, scratch, len, CHUNK_BASE);
+				len = normalize(scratch, len);
+			}
+			chunkToDecimal(s + pos, chunk);
+		}
+		release(scratch);
+		return;
+	}
+
+	// split around 10^(19 * 2^(k-1)): the quotient gives the high
+	// half of the digits and the remainder the low half
+	int pn;
+	const limb *p = decimalPower(k - 1, pn);
+	int half = width / 2;
+	if (cmp(a, an, p, pn) < 0) {
+		for (int i = 0; i < half; i++) {
+			s[i] = '0';
+		}
+		toDecimalRec(s + half, a, an, k - 1);
+		return;
+	}
+
+	int qn = an - pn + 1;
+	limb *q = allocate(qn + pn);
+	limb *r = q + qn;
+	if (pn == 1) {
+		r[0] = divmod1(q, a, an, p[0]);
+	}
+	else {
+		divmod(q, r, a, an, p, pn);
+	}
+	toDecimalRec(s, q, normalize(q, qn), k - 1);
+	toDecimalRec(s + half, r, normalize(r, pn), k - 1);
+	release(q);
+}
+
+// decimal digits of a normalized magnitude
+int toDecimal(char *s, const limb *a, int an) {
+	// find the smallest cached power above a, which fixes the padded
+	// width of the conversion
+	int k = 0, pn;
+	const limb *p = decimalPower(0, pn);
+	while (cmp(a, an, p, pn) >= 0) {
+		p = decimalPower(++k, pn);
+	}
+
+	int width = CHUNK_DIGITS << k;
+	char *padded = new char[width];
+	toDecimalRec(padded, a, an, k);
+
+	// strip the zero padding, keeping at least one digit
+	int start = 0;
+	while (start < width - 1 && padded[start] == '0') {
+		start++;
+	}
+	for (int i = start; i < width; i++) {
+		s[i - start] = padded[i];
+	}
+	delete[] padded;
+	return width - start;
+}
+
+// value of one chunk of up to 19 digits
+static limb decimalToChunk(const char *s, int len) {
+	limb chunk = 0;
+	for (int i = 0; i < len; i++) {
+		chunk = chunk * 10 + (limb)(s[i] - '0');
+	}
+	return chunk;
+}
+
+// parse len digits into a new array, storing its normalized length
+limb *fromDecimal(const char *s, int len, int &rn) {
+	int chunks = (len + CHUNK_DIGITS - 1) / CHUNK_DIGITS;
+
+	if (chunks < 2 * RADIX_DC_THRESHOLD) {
+		// multiply in one chunk at a time, most significant first;
+		// the first chunk takes up the odd digits
+		limb *r = allocate(chunks);
+		int first = len - (chunks - 1) * CHUNK_DIGITS;
+		r[0] = decimalToChunk(s, first);
+		int n = 1;
+		for (int pos = first; pos < len; pos += CHUNK_DIGITS) {
+			limb chunk = decimalToChunk(s + pos, CHUNK_DIGITS);
+			limb carry = mul1(r, r, n, CHUNK_BASE);
+			carry += addTo(r, n, &chunk, 1);
+			r[n++] = carry;
+		}
+		rn = normalize(r, n);
+		return r;
+	}
+
+	// split off the low 19 * 2^k digits, for the largest such part
+	// that leaves a non-empty high part, and recombine as
+	// high * 10^(19 * 2^k) + low
+	int k = 0;
+	while ((2 << k) < chunks) {
+		k++;
+	}
+	int lowDigits = CHUNK_DIGITS << k;
+
+	int hn, ln, pn;
+	limb *high = fromDecimal(s, len - lowDigits, hn);
+	limb *low = fromDecimal(s + len - lowDigits, lowDigits, ln);
+	const limb *p = decimalPower(k, pn);
+
+	int n = hn + pn;
+	limb *r = allocate(n + 1);
+	mul(r, high, hn, p, pn);
+	r[n] = 0;
+	addTo(r, n + 1, low, ln);
+	release(high);
+	release(low);
+	rn = normalize(r, n + 1);
+	return r;
+}
+
+// parse len hexadecimal digits into a new array, storing its
+// normalized length in rn; each limb takes 16 digits from the end
+limb *fromHex(const char *s, int len, int &rn) {
+	int n = (len + 15) / 16;
+	limb *r = allocate(n);
+	zero(r, n);
+	for (int i = 0; i < len; i++) {
+		char c = s[len - 1 - i];
+		limb v = (c <= '9') ? (limb)(c - '0') : (limb)((c | 0x20) - 'a' + 10);
+		r[i / 16] |= v << (4 * (i % 16));
+	}
+	rn = normalize(r, n);
+	return r;
+}
+
+}
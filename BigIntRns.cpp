@@ -0,0 +1,485 @@
+/****************************************************************
+ * BigIntRns.cpp -- residue number system arithmetic
+ ****************************************************************/
+#include <stddef.h>
+#include <iostream>
+#include "BigIntRns.h"
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * residue kernels
+ *
+ * Each prime keeps its Montgomery constants, so a residue product
+ * is one 64 x 64-bit multiplication and one reduction, and the
+ * constants for dividing by it without hardware division, which
+ * turns a BigInt into residues with limbs::mod1Pre(). The primes
+ * are held as separate arrays, one entry per prime, so the loops
+ * below run straight down them.
+ *
+ * Going back to positional form uses Garner's algorithm: with
+ * P_j = p_0 ... p_(j-1), the value is built up as
+ * X_(j+1) = X_j + P_j * ((x_j - X_j) / P_j mod p_j), which needs
+ * X_j mod p_j (one pass over X_j) and the inverse of P_j mod p_j
+ * (kept in the basis). That is quadratic in the number of primes,
+ * like the first conversion, which is why values should stay in
+ * residue form for as long as possible.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// residue count from which the residue loops are shared out as
+// parallel tasks, and the work (limbs times primes) from which
+// conversion into residues is split the same way
+const int RNS_PARALLEL_RESIDUES = 1 << 13;
+const long RNS_PARALLEL_CONVERT = 1L << 20;
+
+// the primes of a basis, one entry per prime in each array
+struct RnsPrimes {
+	int k; // number of primes
+	long bits; // the bound the basis was made for
+	limb *p; // the primes, all below 2^62
+	limb *pinv; // -p^-1 mod 2^64
+	limb *r2; // 2^128 mod p
+	limb *d; // p shifted so its top bit is set
+	int *shift;
+	limb *v; // reciprocal(d)
+	limb *garner; // (p_0 ... p_(j-1))^-1 mod p_j in Montgomery form
+};
+
+// Montgomery reduction of t < p * 2^64 into [0, p)
+static inline limb redc(dlimb t, limb p, limb pinv) {
+	limb m = (limb)t * pinv;
+	limb u = (limb)((t + (dlimb)m * p) >> LIMB_BITS);
+	return (u >= p) ? u - p : u;
+}
+
+// a * b mod n, for the primality test
+static limb mulmod(limb a, limb b, limb n) {
+	return (limb)((dlimb)a * b % n);
+}
+
+// true if odd n > 37 is prime, by Miller-Rabin with bases that are
+// known to decide every n below 2^64
+static bool isPrime(limb n) {
+	static const limb bases[12] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+	for (int i = 0; i < 12; i++) {
+		if (n % bases[i] == 0) return false;
+	}
+	limb q = n - 1;
+	int s = 0;
+	while ((q & 1) == 0) {
+		q >>= 1;
+		s++;
+	}
+	for (int i = 0; i < 12; i++) {
+		// x = base^q mod n
+		limb x = 1, b = bases[i];
+		for (limb e = q; e > 0; e >>= 1) {
+			if (e & 1) x = mulmod(x, b, n);
+			b = mulmod(b, b, n);
+		}
+		if (x == 1 || x == n - 1) continue;
+		bool composite = true;
+		for (int j = 1; j < s && composite; j++) {
+			x = mulmod(x, x, n);
+			if (x == n - 1) composite = false;
+		}
+		if (composite) return false;
+	}
+	return true;
+}
+
+// base^e in Montgomery form
+static limb powMont(limb base, limb e, limb p, limb pinv, limb one) {
+	limb x = one;
+	while (e > 0) {
+		if (e & 1) x = redc((dlimb)x * base, p, pinv);
+		base = redc((dlimb)base * base, p, pinv);
+		e >>= 1;
+	}
+	return x;
+}
+
+// the largest primes below 2^62, enough for values below 2^bits in
+// magnitude (each prime adds more than 61 bits, and the sign needs
+// one)
+static RnsPrimes *rnsInit(long bits) {
+	if (bits < 1) bits = 1;
+	RnsPrimes *P = new RnsPrimes;
+	int k = (int)((bits + 1) / 61 + 1);
+	P->k = k;
+	P->bits = bits;
+	P->p = allocateHeap(k);
+	P->pinv = allocateHeap(k);
+	P->r2 = allocateHeap(k);
+	P->d = allocateHeap(k);
+	P->shift = new int[k];
+	P->v = allocateHeap(k);
+	P->garner = allocateHeap(k);
+
+	limb candidate = ((limb)1 << 62) - 1;
+	for (int i = 0; i < k; i++) {
+		while (!isPrime(candidate)) candidate -= 2;
+		limb p = candidate;
+		candidate -= 2;
+
+		limb inv = p; // Newton iteration for p^-1 mod 2^64
+		for (int t = 0; t < 5; t++) {
+			inv *= 2 - p * inv;
+		}
+		dlimb r = ((dlimb)1 << LIMB_BITS) % p;
+		P->p[i] = p;
+		P->pinv[i] = (limb)0 - inv;
+		P->r2[i] = (limb)(r * r % p);
+		P->shift[i] = __builtin_clzll(p);
+		P->d[i] = p << P->shift[i];
+		P->v[i] = reciprocal(P->d[i]);
+	}
+
+	// the Garner inverses, from a running product of the primes
+	limb *prefix = allocate(k + 1);
+	prefix[0] = 1;
+	int pn = 1;
+	for (int j = 0; j < k; j++) {
+		limb p = P->p[j], pinv = P->pinv[j];
+		limb m = mod1Pre(prefix, pn, P->d[j], P->shift[j], P->v[j]);
+		limb mont = redc((dlimb)m * P->r2[j], p, pinv);
+		limb one = redc(P->r2[j], p, pinv);
+		P->garner[j] = powMont(mont, p - 2, p, pinv, one);
+		limb high = mul1(prefix, prefix, pn, p);
+		if (high != 0) prefix[pn++] = high;
+	}
+	release(prefix);
+	return P;
+}
+
+static void rnsFree(RnsPrimes *P) {
+	release(P->p);
+	release(P->pinv);
+	release(P->r2);
+	release(P->d);
+	delete[] P->shift;
+	release(P->v);
+	release(P->garner);
+	delete P;
+}
+
+// one slice [from, to) of a residue operation for a task: r = a op b
+// for op '+', '-' or '*', r = -a for 'n', and for 'c' the residues
+// of the an-limb magnitude a (negated if neg is set)
+struct RnsJob {
+	RnsPrimes const *P;
+	char op;
+	limb *r;
+	const limb *a;
+	const limb *b;
+	int an;
+	bool neg;
+	int from, to;
+};
+
+static void runRns(void *arg) {
+	RnsJob *job = (RnsJob *)arg;
+	RnsPrimes const& P = *job->P;
+	limb *r = job->r;
+	const limb *a = job->a, *b = job->b;
+	switch (job->op) {
+	case '+':
+		for (int i = job->from; i < job->to; i++) {
+			limb s = a[i] + b[i];
+			r[i] = (s >= P.p[i]) ? s - P.p[i] : s;
+		}
+		break;
+	case '-':
+		for (int i = job->from; i < job->to; i++) {
+			r[i] = (a[i] >= b[i]) ? a[i] - b[i] : a[i] + P.p[i] - b[i];
+		}
+		break;
+	case '*':
+		for (int i = job->from; i < job->to; i++) {
+			r[i] = redc((dlimb)a[i] * b[i], P.p[i], P.pinv[i]);
+		}
+		break;
+	case 'n':
+		for (int i = job->from; i < job->to; i++) {
+			r[i] = (a[i] == 0) ? 0 : P.p[i] - a[i];
+		}
+		break;
+	case 'c':
+		for (int i = job->from; i < job->to; i++) {
+			limb m = mod1Pre(a, job->an, P.d[i], P.shift[i], P.v[i]);
+			if (job->neg && m != 0) m = P.p[i] - m;
+			r[i] = redc((dlimb)m * P.r2[i], P.p[i], P.pinv[i]);
+		}
+		break;
+	}
+}
+
+// run a residue operation over all k primes, in parallel slices
+// when there is enough of it
+static void rnsRun(RnsJob const& job, long work) {
+	int k = job.P->k;
+	int parts = 1;
+	int threads = concurrency();
+	if (threads > 1 && (job.op == 'c' ? work >= RNS_PARALLEL_CONVERT : k >= RNS_PARALLEL_RESIDUES)) {
+		parts = (threads < 64) ? threads : 64;
+		if (parts > k) parts = k;
+	}
+	RnsJob jobs[64];
+	Task tasks[64];
+	for (int i = 0; i < parts; i++) {
+		jobs[i] = job;
+		jobs[i].from = (int)((long)k * i / parts);
+		jobs[i].to = (int)((long)k * (i + 1) / parts);
+		tasks[i].run = runRns;
+		tasks[i].arg = &jobs[i];
+	}
+	runTasks(tasks, parts);
+}
+
+// r = a op b over every residue ('+', '-', '*'; 'n' negates a)
+static void rnsOp(RnsPrimes const& P, char op, limb *r, const limb *a, const limb *b) {
+	RnsJob job = {&P, op, r, a, b, 0, false, 0, 0};
+	rnsRun(job, P.k);
+}
+
+// the residues of the an-limb magnitude a, negated if neg is set
+static void rnsFromLimbs(RnsPrimes const& P, limb *r, const limb *a, int an, bool neg) {
+	RnsJob job = {&P, 'c', r, a, NULL, an, neg, 0, 0};
+	rnsRun(job, (long)an * P.k);
+}
+
+// the value of the residues x as a magnitude of at most k + 1 limbs
+// in r (room for k + 1), returning its length and setting neg if it
+// lies in the upper half of the range, which stands for negatives
+static int rnsToLimbs(RnsPrimes const& P, limb *r, const limb *x, bool &neg) {
+	int k = P.k;
+	limb *prefix = allocate(k + 1);
+	limb *upper = allocate(k + 1);
+	prefix[0] = 1;
+	int pn = 1;
+	r[0] = 0;
+	int rn = 1;
+	for (int j = 0; j < k; j++) {
+		limb p = P.p[j], pinv = P.pinv[j];
+		// the digit (x_j - X) / P_j mod p_j
+		limb xj = redc(x[j], p, pinv);
+		limb m = mod1Pre(r, rn, P.d[j], P.shift[j], P.v[j]);
+		limb diff = (xj >= m) ? xj - m : xj + p - m;
+		limb digit = redc((dlimb)diff * P.garner[j], p, pinv);
+
+		// X += P_j * digit, then P_j *= p_j
+		if (rn < pn) {
+			zero(r + rn, pn - rn);
+			rn = pn;
+		}
+		limb carry = addmul1(r, prefix, pn, digit);
+		if (carry != 0) {
+			if (rn > pn) carry = addTo(r + pn, rn - pn, &carry, 1);
+			if (carry != 0) r[rn++] = carry;
+		}
+		rn = normalize(r, rn);
+		limb high = mul1(prefix, prefix, pn, p);
+		if (high != 0) prefix[pn++] = high;
+	}
+
+	// X above M / 2 means X - M
+	sub(upper, prefix, pn, r, rn);
+	int un = normalize(upper, pn);
+	neg = cmp(r, rn, upper, un) > 0;
+	if (neg) {
+		copy(r, upper, un);
+		rn = un;
+	}
+	release(upper);
+	release(prefix);
+	return rn;
+}
+
+}
+
+/*****************************************************************
+ * RnsBasis
+ *****************************************************************/
+
+// choose the primes
+RnsBasis::RnsBasis(long bits) : primes(limbs::rnsInit(bits)) {}
+
+RnsBasis::~RnsBasis() {
+	limbs::rnsFree(primes);
+}
+
+// number of primes
+int RnsBasis::size() const {
+	return primes->k;
+}
+
+// magnitude bound
+long RnsBasis::bits() const {
+	return primes->bits;
+}
+
+/*****************************************************************
+ * RnsBigInt
+ *****************************************************************/
+
+// an undefined value, or a result to be filled in
+RnsBigInt::RnsBigInt(RnsBasis const *b) : base(b), residues(NULL) {
+	if (base != NULL) residues = limbs::allocate(base->primes->k);
+}
+
+// the residues of a BigInt
+RnsBigInt::RnsBigInt(RnsBasis const& basis, BigInt const& value) : base(&basis), residues(NULL) {
+	if (value.dataLength <= 0) {
+		base = NULL;
+		return;
+	}
+	residues = limbs::allocate(basis.primes->k);
+	limbs::rnsFromLimbs(*basis.primes, residues, value.data, value.dataLength, value.neg);
+}
+
+// the residues of a long
+RnsBigInt::RnsBigInt(RnsBasis const& basis, long value) : base(&basis), residues(NULL) {
+	// negate as unsigned so LONG_MIN survives
+	limb magnitude = (value < 0) ? (limb)0 - (limb)value : (limb)value;
+	residues = limbs::allocate(basis.primes->k);
+	limbs::rnsFromLimbs(*basis.primes, residues, &magnitude, 1, value < 0);
+}
+
+// copy constructor
+RnsBigInt::RnsBigInt(RnsBigInt const& orig) : RnsBigInt(orig.base) {
+	if (base != NULL) limbs::copy(residues, orig.residues, base->primes->k);
+}
+
+// move constructor
+RnsBigInt::RnsBigInt(RnsBigInt&& orig) noexcept : base(orig.base), residues(orig.residues) {
+	orig.base = NULL;
+	orig.residues = NULL;
+}
+
+// destructor
+RnsBigInt::~RnsBigInt() {
+	if (residues != NULL) limbs::release(residues);
+}
+
+// assignment operator
+RnsBigInt& RnsBigInt::operator=(RnsBigInt const& src) {
+	if (this == &src) return *this;
+	// keep the array if it already has the right size
+	if (src.base == NULL || base == NULL || base->primes->k != src.base->primes->k) {
+		if (residues != NULL) limbs::release(residues);
+		residues = (src.base != NULL) ? limbs::allocate(src.base->primes->k) : NULL;
+	}
+	base = src.base;
+	if (base != NULL) limbs::copy(residues, src.residues, base->primes->k);
+	return *this;
+}
+
+// move assignment operator
+RnsBigInt& RnsBigInt::operator=(RnsBigInt&& src) noexcept {
+	if (this == &src) return *this;
+	if (residues != NULL) limbs::release(residues);
+	base = src.base;
+	residues = src.residues;
+	src.base = NULL;
+	src.residues = NULL;
+	return *this;
+}
+
+// the basis
+RnsBasis const *RnsBigInt::basis() const {
+	return base;
+}
+
+// defined test
+bool RnsBigInt::isDefined() const {
+	return base != NULL;
+}
+
+// the shared basis
+RnsBasis const *RnsBigInt::common(RnsBigInt const& x, RnsBigInt const& y) {
+	return (x.base == y.base) ? x.base : NULL;
+}
+
+// per-residue arithmetic
+RnsBigInt RnsBigInt::combine(RnsBigInt const& x, RnsBigInt const& y, char op) {
+	RnsBigInt result(common(x, y));
+	if (result.base != NULL) {
+		limbs::rnsOp(*result.base->primes, op, result.residues, x.residues, y.residues);
+	}
+	return result;
+}
+
+// binary operators
+RnsBigInt RnsBigInt::operator+(RnsBigInt const& other) const {
+	return combine(*this, other, '+');
+}
+
+RnsBigInt RnsBigInt::operator-(RnsBigInt const& other) const {
+	return combine(*this, other, '-');
+}
+
+RnsBigInt RnsBigInt::operator*(RnsBigInt const& other) const {
+	return combine(*this, other, '*');
+}
+
+// negation
+RnsBigInt RnsBigInt::operator-() const {
+	RnsBigInt result(base);
+	if (base != NULL) {
+		limbs::rnsOp(*base->primes, 'n', result.residues, residues, NULL);
+	}
+	return result;
+}
+
+// compound operators work in place
+RnsBigInt& RnsBigInt::operator+=(RnsBigInt const& other) {
+	if (common(*this, other) == NULL) return *this = RnsBigInt((RnsBasis const *)NULL);
+	limbs::rnsOp(*base->primes, '+', residues, residues, other.residues);
+	return *this;
+}
+
+RnsBigInt& RnsBigInt::operator-=(RnsBigInt const& other) {
+	if (common(*this, other) == NULL) return *this = RnsBigInt((RnsBasis const *)NULL);
+	limbs::rnsOp(*base->primes, '-', residues, residues, other.residues);
+	return *this;
+}
+
+RnsBigInt& RnsBigInt::operator*=(RnsBigInt const& other) {
+	if (common(*this, other) == NULL) return *this = RnsBigInt((RnsBasis const *)NULL);
+	limbs::rnsOp(*base->primes, '*', residues, residues, other.residues);
+	return *this;
+}
+
+// equality: the residues are fully reduced, so equal values have
+// equal residues (undefined equals nothing)
+bool RnsBigInt::operator==(RnsBigInt const& other) const {
+	if (common(*this, other) == NULL) return false;
+	for (int i = 0; i < base->primes->k; i++) {
+		if (residues[i] != other.residues[i]) return false;
+	}
+	return true;
+}
+
+bool RnsBigInt::operator!=(RnsBigInt const& other) const {
+	return !(*this == other);
+}
+
+// back to positional form
+BigInt RnsBigInt::toBigInt() const {
+	if (base == NULL) return BigInt(-1, false);
+	int k = base->primes->k;
+	BigInt result(k + 1, false);
+	bool neg = false;
+	int rn = limbs::rnsToLimbs(*base->primes, result.data, residues, neg);
+	limbs::zero(result.data + rn, k + 1 - rn);
+	result.neg = neg;
+	result.trim();
+	return result;
+}
+
+// print the value
+std::ostream & operator<<(std::ostream& os, RnsBigInt const& num) {
+	return os << num.toBigInt();
+}
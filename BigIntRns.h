@@ -0,0 +1,127 @@
+/****************************************************************
+ * BigIntRns.h -- residue number system arithmetic
+ ****************************************************************/
+#ifndef BIGINTRNS_H
+#define BIGINTRNS_H
+
+#include <iostream>
+#include <stdint.h>
+#include "BigInt.h"
+
+namespace limbs {
+struct RnsPrimes;
+}
+
+/*****************************************************************
+ * residue number system
+ *
+ * An RnsBigInt holds an integer x as its residues x mod p_i for
+ * the primes p_i of an RnsBasis, all just below 2^62. Addition,
+ * subtraction and multiplication then work on each residue on its
+ * own, with no carries between them, so a long chain of them costs
+ * only a few word operations per prime per step, and large bases
+ * share the primes out among the thread pool (see
+ * BigInt::setThreads()). Conversion to and from BigInt goes through
+ * the Chinese remainder theorem and is the expensive part, so it is
+ * meant for the start and end of a computation:
+ *
+ *   RnsBasis basis(4096); // values below 2^4096 in magnitude
+ *   RnsBigInt x(basis, a), y(basis, b);
+ *   for (...) x = x * x + y;
+ *   BigInt result = x.toBigInt();
+ *
+ * Every value, including intermediate ones, must stay within the
+ * bound the basis was made for; anything larger wraps around modulo
+ * the product of the primes without warning. Comparing for equality
+ * is exact, but order comparisons need the positional form. Special
+ * BigInt values, and operations mixing two bases, give an undefined
+ * RnsBigInt, which converts back to undefined.
+ *
+ *****************************************************************/
+
+// a set of primes bounding the values RnsBigInts over it can hold.
+// A basis must outlive every RnsBigInt built on it
+class RnsBasis {
+private:
+	limbs::RnsPrimes *primes;
+
+	RnsBasis(RnsBasis const&) = delete;
+	RnsBasis& operator=(RnsBasis const&) = delete;
+
+	friend class RnsBigInt;
+
+public:
+	// enough primes for values below 2^bits in magnitude
+	explicit RnsBasis(long bits);
+
+	~RnsBasis();
+
+	// the number of primes
+	int size() const;
+
+	// the magnitude bound, in bits, the basis was made for
+	long bits() const;
+};
+
+class RnsBigInt {
+private:
+	typedef uint64_t limb;
+
+	RnsBasis const *base; // NULL when undefined
+	limb *residues; // one per prime, in Montgomery form
+
+	// an undefined value, or room for the residues of a result over b
+	explicit RnsBigInt(RnsBasis const *b);
+
+	// the basis two operands share, or NULL if they differ or either
+	// is undefined
+	static RnsBasis const *common(RnsBigInt const& x, RnsBigInt const& y);
+
+	// x op y per residue (op is '+', '-' or '*')
+	static RnsBigInt combine(RnsBigInt const& x, RnsBigInt const& y, char op);
+
+public:
+	// the residues of value over basis
+	RnsBigInt(RnsBasis const& basis, BigInt const& value);
+
+	// the residues of a long
+	RnsBigInt(RnsBasis const& basis, long value);
+
+	RnsBigInt(RnsBigInt const& orig);
+
+	RnsBigInt(RnsBigInt&& orig) noexcept;
+
+	~RnsBigInt();
+
+	RnsBigInt& operator=(RnsBigInt const& src);
+
+	RnsBigInt& operator=(RnsBigInt&& src) noexcept;
+
+	// the basis, or NULL if the value is undefined
+	RnsBasis const *basis() const;
+
+	// true unless the value is undefined
+	bool isDefined() const;
+
+	// carry-free arithmetic, one residue at a time
+	RnsBigInt operator+(RnsBigInt const& other) const;
+	RnsBigInt operator-(RnsBigInt const& other) const;
+	RnsBigInt operator*(RnsBigInt const& other) const;
+	RnsBigInt operator-() const;
+
+	RnsBigInt& operator+=(RnsBigInt const& other);
+	RnsBigInt& operator-=(RnsBigInt const& other);
+	RnsBigInt& operator*=(RnsBigInt const& other);
+
+	// exact equality (values within the basis bound)
+	bool operator==(RnsBigInt const& other) const;
+	bool operator!=(RnsBigInt const& other) const;
+
+	// the value in positional form, by Garner's algorithm
+	BigInt toBigInt() const;
+};
+
+// print the value in decimal
+std::ostream & operator<<(std::ostream& os, RnsBigInt const& num);
+
+#endif
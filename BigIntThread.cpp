@@ -0,0 +1,192 @@
+/****************************************************************
+ * BigIntThread.cpp -- thread pool for parallel multiplication
+ ****************************************************************/
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BigIntLimbs.h"
+
+/*****************************************************************
+ * thread pool
+ *
+ * The multiplication tiers hand independent pieces of work (the
+ * sub-products of Karatsuba and Toom-Cook, the three NTT primes and
+ * blocks of butterflies, ranges of CRT coefficients) to runTasks()
+ * as batches. The calling thread runs tasks of its batch itself,
+ * and queues one helper job for each further thread the batch may
+ * use; a worker that picks up a helper job keeps taking tasks of
+ * that batch until none are left. A thread waiting for its helpers
+ * to finish runs other queued jobs meanwhile, so it never sits idle
+ * while work is queued, and a task may start batches of its own
+ * without the pool running out of threads.
+ *
+ * The pool holds setThreads() - 1 workers, none by default, so
+ * unless it is asked for all work stays on the calling thread. Each
+ * thread may lower its own share with setConcurrency(). A batch
+ * started under a limit of n threads gets at most n - 1 helpers,
+ * and the limit is divided among the caller and its helpers for
+ * any batches their tasks start in turn, so the whole operation
+ * stays within n threads. Helper jobs always allocate from the
+ * per-thread caches, whichever thread picks them up, since an
+ * Arena belongs to the one thread that opened it.
+ *
+ *****************************************************************/
+
+namespace limbs {
+
+// a batch of tasks being worked on
+struct Batch {
+	Task const *tasks;
+	int count;
+	int next; // first task not yet taken (under the lock)
+	int share; // concurrency each helper's tasks run under
+	int helpers; // helper jobs queued and not yet finished (under the lock)
+};
+
+// the workers and their queue of helper jobs
+struct Pool {
+	std::mutex lock;
+	std::condition_variable wake; // new jobs, finished helpers, stop
+	std::deque<Batch *> queue;
+	std::vector<std::thread> workers;
+	bool stopping;
+
+	Pool() : stopping(false) {}
+
+	~Pool() {
+		stop();
+	}
+
+	// let the workers finish and join them
+	void stop();
+};
+
+static Pool &pool() {
+	static Pool instance;
+	return instance;
+}
+
+// threads the pool may use in all, and the calling thread's own
+// limit on top of that (0 for none)
+static std::atomic<int> poolThreads(1);
+static thread_local int localLimit = 0;
+
+// run tasks of a batch under the given concurrency until none are
+// left to take; called and returns with the lock held
+static void runShare(Batch *batch, int limit, std::unique_lock<std::mutex> &held) {
+	int saved = localLimit;
+	localLimit = limit;
+	while (batch->next < batch->count) {
+		Task const &task = batch->tasks[batch->next++];
+		held.unlock();
+		task.run(task.arg);
+		held.lock();
+	}
+	localLimit = saved;
+}
+
+// run a helper job under the default allocator, so that a thread
+// helping out from inside an Arena never puts another thread's
+// arrays in it; called and returns with the lock held
+static void help(Batch *batch, std::unique_lock<std::mutex> &held) {
+	Allocator *savedAllocator = setAllocator(NULL);
+	runShare(batch, batch->share, held);
+	setAllocator(savedAllocator);
+	if (--batch->helpers == 0) pool().wake.notify_all();
+}
+
+// a worker: run helper jobs until the pool stops
+static void workerLoop() {
+	Pool &p = pool();
+	std::unique_lock<std::mutex> held(p.lock);
+	for (;;) {
+		while (p.queue.empty() && !p.stopping) {
+			p.wake.wait(held);
+		}
+		if (p.queue.empty()) return;
+		Batch *batch = p.queue.front();
+		p.queue.pop_front();
+		help(batch, held);
+	}
+}
+
+void Pool::stop() {
+	{
+		std::lock_guard<std::mutex> held(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	workers.clear();
+	stopping = false;
+}
+
+// resize the pool
+int setThreads(int n) {
+	if (n < 1) n = 1;
+	Pool &p = pool();
+	p.stop();
+	for (int i = 1; i < n; i++) {
+		p.workers.push_back(std::thread(workerLoop));
+	}
+	return poolThreads.exchange(n);
+}
+
+// set the calling thread's limit
+int setConcurrency(int n) {
+	int previous = localLimit;
+	localLimit = (n < 0) ? 0 : n;
+	return previous;
+}
+
+// threads the calling thread's work may use
+int concurrency() {
+	int n = poolThreads.load(std::memory_order_relaxed);
+	return (localLimit > 0 && localLimit < n) ? localLimit : n;
+}
+
+// run a batch, sharing it with at most concurrency() - 1 helpers
+void runTasks(Task const *tasks, int count) {
+	int limit = concurrency();
+	if (limit <= 1 || count <= 1) {
+		for (int i = 0; i < count; i++) {
+			tasks[i].run(tasks[i].arg);
+		}
+		return;
+	}
+
+	// the caller and each helper get an even share of the limit, and
+	// the caller takes what is left over
+	int helpers = (limit - 1 < count - 1) ? limit - 1 : count - 1;
+	Batch batch = {tasks, count, 0, limit / (helpers + 1), helpers};
+	int callerShare = limit - helpers * batch.share;
+
+	Pool &p = pool();
+	std::unique_lock<std::mutex> held(p.lock);
+	for (int i = 0; i < helpers; i++) {
+		p.queue.push_back(&batch);
+	}
+	p.wake.notify_all();
+
+	runShare(&batch, callerShare, held);
+
+	// help with queued jobs (this batch's or any other) until every
+	// helper of the batch has finished
+	while (batch.helpers > 0) {
+		if (p.queue.empty()) {
+			p.wake.wait(held);
+			continue;
+		}
+		Batch *other = p.queue.front();
+		p.queue.pop_front();
+		help(other, held);
+	}
+}
+
+}
@@ -2,12 +2,34 @@
  * Defines main function containing some BigInt tests
  *****************************************************************/
 #include <iostream>
+#include <sstream>
 #include <stddef.h>
 #include <stdlib.h>
+#include <chrono>
+#include <thread>
 #include "BigInt.h"
+#include "BigIntExpr.h"
+#include "BigIntLimbs.h"
+#include "BigIntRns.h"
 
 using namespace std;
 
+// multiply a by b a few times inside an arena, keeping the last
+// product in *result
+static void arenaProducts(BigInt const *a, BigInt const *b, BigInt *result) {
+	for (int i = 0; i < 4; i++) {
+		BigInt::Arena arena;
+		*result = arena.keep(*a * *b);
+	}
+}
+
+// a pool task: note the thread it ran on, slowly enough that idle
+// workers would have time to join in
+static void recordThread(void *arg) {
+	this_thread::sleep_for(chrono::milliseconds(10));
+	*(thread::id *)arg = this_thread::get_id();
+}
+
 int main(void) {
 	int a = 92104;
 	int b = 74836;
@@ -99,6 +121,12 @@ int main(void) {
 
 	cout << m1 << endl << endl;
 
+	// the product-tree factorial agrees with the chain
+	cout << (m1 == BigInt::factorial(1000)) << endl << endl;
+
+	// large enough for the Karatsuba tier
+	cout << ((m1 * m1) / m1 == m1) << endl << endl;
+
 	cout << (BigInt(10000) - BigInt(999)) << endl;
 
 	cout << (BigInt(894) / BigInt(56)) << endl;
@@ -227,6 +255,158 @@ int main(void) {
 	cout << 0 / inf << endl;
 	cout << 0 / ninf << endl;
 
+	cout << endl;
+
+	cout << BigInt("-123456789012345678901234567890") << endl;
+	cout << BigInt("0xFFFFFFFFFFFFFFFFFFFFFFFF") << endl;
+	cout << BigInt("-0") << endl;
+	cout << BigInt("12ab") << endl;
+	cout << BigInt("") << endl;
+
+	istringstream in(" 98765432109876543210 -0x1F junk");
+	BigInt r1(0), r2(0), r3(0);
+	in >> r1 >> r2;
+	cout << r1 << " " << r2 << endl;
+	in >> r3;
+	cout << r3 << " " << in.fail() << endl;
+
+	// a lone zero at the end of the input reads cleanly
+	istringstream zero("0"), plusZero("+0"), minusZero("-0");
+	BigInt z1(1), z2(1), z3(1);
+	zero >> z1;
+	plusZero >> z2;
+	minusZero >> z3;
+	cout << z1 << " " << z2 << " " << z3 << " " << (zero.fail() || plusZero.fail() || minusZero.fail()) << endl;
+
+	cout << endl;
+
+	// temporaries of 200! live in the arena; only the result is kept
+	BigInt kept(0);
+	{
+		BigInt::Arena arena;
+		BigInt f(1);
+		for (long i = 2; i <= 200; i++) {
+			f *= i;
+		}
+		kept = arena.keep(f);
+	}
+	cout << kept << endl;
+
+	// fused evaluation: each sum is built in a single result array
+	BigInt fused = lazy(num2) + num3 + num7;
+	cout << fused << " " << (fused == num2 + num3 + num7) << endl;
+	fused = lazy(kept) * kept - kept + num2;
+	cout << (fused == kept * kept - kept + num2) << endl;
+
+	// compound operators work in place; reserve() sizes the array up
+	// front so the loop never reallocates
+	BigInt total(0);
+	total.reserve(2048);
+	for (long i = 1; i <= 100; i++) {
+		total += kept;
+		total -= i;
+	}
+	cout << (total == kept * 100 - 5050) << " " << total.capacity() << endl;
+
+	// carry-save summation, resolved once at the end
+	BigInt::Accumulator ledger;
+	for (long i = 1; i <= 1000; i++) {
+		ledger += kept;
+		ledger -= BigInt(i);
+	}
+	cout << (ledger.result() == kept * 1000 - 500500) << endl;
+
+	// modular exponentiation: Fermat's little theorem for the prime
+	// 2^127 - 1, with an odd (Montgomery) and an even (Barrett) modulus
+	BigInt p127("0x7FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF");
+	cout << BigInt::powMod(kept, p127 - 1, p127) << " ";
+	cout << BigInt::powMod(BigInt(3), BigInt(1000), BigInt(1000000000000000000L)) << endl;
+
+	// a shared modulus: the inverse of 200! mod 2^127 - 1 undoes it,
+	// and 3^-1000 matches Fermat's 3^(p - 1001)
+	BigInt::Modulus field(p127);
+	BigInt inverse = field.invMod(kept);
+	cout << field.mulMod(kept, inverse) << " ";
+	cout << (field.powMod(BigInt(3), BigInt(-1000)) == field.powMod(BigInt(3), p127 - 1001)) << " ";
+	cout << field.subMod(BigInt(1), BigInt(2)) << endl;
+
+	// a prepared divisor: digit sums of 200! in base 10^18
+	BigInt::Divisor base(BigInt(1000000000000000000L));
+	BigInt digits = kept, digitSum = 0;
+	while (digits != 0) {
+		digitSum += digits % base;
+		digits = digits / base;
+	}
+	cout << (digitSum % 9) << " " << (kept / base == kept / base.divisor()) << endl;
+
+	// gcd and friends: 200! is a multiple of 210, and coprime to the
+	// prime 2^127 - 1
+	BigInt x = 0, y = 0;
+	BigInt g = BigInt::extendedGcd(kept, p127, x, y);
+	cout << BigInt::gcd(kept, BigInt(-210)) << " " << BigInt::lcm(BigInt(12), BigInt(18)) << " ";
+	cout << g << " " << (kept * x + p127 * y == g) << " " << (BigInt::modInverse(kept, p127) == inverse) << endl;
+
+	// combinatorics: C(1000, 500) = 1000! / (500!)^2, and 30# = 6469693230
+	BigInt half = BigInt::factorial(500);
+	cout << (BigInt::binomial(1000, 500) == m1 / (half * half)) << " " << BigInt::primorial(30) << endl;
+
+	// batch product and sum: 1 * 2 * ... * 20 and the numbers above
+	long upTo20[20];
+	for (int i = 0; i < 20; i++) {
+		upTo20[i] = i + 1;
+	}
+	BigInt batch[3] = {m1, half, kept};
+	cout << (BigInt::product(upTo20, upTo20 + 20) == BigInt::factorial(20)) << " ";
+	cout << (BigInt::product(batch, batch + 3) == m1 * half * kept) << " " << (BigInt::sum(batch, batch + 3) == m1 + half + kept) << endl;
+
+	// a square of 20000! (about 4000 limbs) shared between two
+	// threads matches the single-threaded one
+	BigInt::setThreads(2);
+	BigInt huge = BigInt::factorial(20000);
+	BigInt shared = huge.square();
+	BigInt::setThreads(1);
+	cout << (shared == huge.square()) << endl;
+
+	// products of about 8000 limbs on a thread inside an arena, while
+	// this thread shares its own products with the same pool
+	BigInt other = shared + 1;
+	BigInt inArena = 0;
+	BigInt::setThreads(4);
+	thread helper(arenaProducts, &shared, &other, &inArena);
+	BigInt outside = other * shared;
+	helper.join();
+	BigInt::setThreads(1);
+	cout << (inArena == outside) << endl;
+
+	// a batch of 16 tasks under a Concurrency of 2 runs on at most
+	// two of the pool's 8 threads
+	BigInt::setThreads(8);
+	thread::id ran[16];
+	limbs::Task tasks[16];
+	for (int i = 0; i < 16; i++) {
+		tasks[i].run = recordThread;
+		tasks[i].arg = &ran[i];
+	}
+	{
+		BigInt::Concurrency two(2);
+		limbs::runTasks(tasks, 16);
+	}
+	BigInt::setThreads(1);
+	int distinct = 0;
+	for (int i = 0; i < 16; i++) {
+		int j = 0;
+		while (j < i && ran[j] != ran[i]) j++;
+		if (j == i) distinct++;
+	}
+	cout << (distinct <= 2) << endl;
+
+	// residue arithmetic: (200!)^2 - 200! * 7 + 1 without carries,
+	// in a basis with room for 2^4000
+	RnsBasis basis(4000);
+	RnsBigInt r(basis, kept);
+	RnsBigInt polynomial = r * r - r * RnsBigInt(basis, 7L) + RnsBigInt(basis, 1L);
+	cout << (polynomial.toBigInt() == kept * kept - kept * 7 + 1) << " " << ((-r).toBigInt() == -kept) << endl;
+
 	cout << endl << "DONE" << endl;
 
 	return EXIT_SUCCESS;